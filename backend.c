@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "backend.h"
+#include "util.h"
+
+#define OP_DISK(op) ((op) >> 28)
+#define OP_BLOCK(op) (((op) >> 20) & 0xff)
+#define OP_CMD(op) (((op) >> 14) & 0x3f)
+
+/* net: a JBOD server */
+
+typedef struct {
+  jbod_backend_t base;
+  jbod_conn_t *conn;
+  jbod_conn_t own;
+} net_backend_t;
+
+static int net_operation(jbod_backend_t *be, uint32_t op, uint8_t *block)
+{
+  return jbod_conn_operation(((net_backend_t *)be)->conn, op, block);
+}
+
+static bool net_has_extents(jbod_backend_t *be)
+{
+  return ((net_backend_t *)be)->conn->version >= JBOD_PROTO_V2;
+}
+
+static int net_read_extent(jbod_backend_t *be, int disk, int block, int count, uint8_t *buf)
+{
+  return jbod_conn_read_extent(((net_backend_t *)be)->conn, disk, block, count, buf);
+}
+
+static int net_write_extent(jbod_backend_t *be, int disk, int block, int count, const uint8_t *buf)
+{
+  return jbod_conn_write_extent(((net_backend_t *)be)->conn, disk, block, count, buf);
+}
+
+/* the server applies every write before it answers */
+static int net_flush(jbod_backend_t *be)
+{
+  return 0;
+}
+
+static int net_geometry(jbod_backend_t *be, jbod_geometry_t *geometry)
+{
+  return jbod_conn_geometry(((net_backend_t *)be)->conn, geometry);
+}
+
+static void net_set_deadline(jbod_backend_t *be, int64_t deadline_ns)
+{
+  jbod_conn_set_deadline(((net_backend_t *)be)->conn, deadline_ns);
+}
+
+static unsigned net_generation(jbod_backend_t *be)
+{
+  return ((net_backend_t *)be)->conn->generation;
+}
+
+static void net_close(jbod_backend_t *be)
+{
+  net_backend_t *nb = (net_backend_t *)be;
+  if (nb->conn != &nb->own)
+    return;
+  jbod_conn_close(nb->conn);
+  free(nb);
+}
+
+static const jbod_backend_ops_t net_ops = {
+  .name = "net",
+  .operation = net_operation,
+  .has_extents = net_has_extents,
+  .read_extent = net_read_extent,
+  .write_extent = net_write_extent,
+  .flush = net_flush,
+  .geometry = net_geometry,
+  .set_deadline = net_set_deadline,
+  .generation = net_generation,
+  .block_ptr = NULL,
+  .close = net_close,
+};
+
+jbod_backend_t *jbod_backend_net_open(const char *ip, uint16_t port)
+{
+  net_backend_t *nb = calloc(1, sizeof(net_backend_t));
+  if (!nb)
+    return NULL;
+  nb->base.ops = &net_ops;
+  nb->conn = &nb->own;
+  if (!jbod_conn_open(nb->conn, ip, port)) {
+    free(nb);
+    return NULL;
+  }
+  return &nb->base;
+}
+
+jbod_backend_t *jbod_backend_default(void)
+{
+  static net_backend_t default_backend = { .base = { &net_ops } };
+  /* bound lazily, like the default connection itself */
+  default_backend.conn = jbod_default_conn();
+  return &default_backend.base;
+}
+
+/* local: jbod.o in this process */
+
+static int local_operation(jbod_backend_t *be, uint32_t op, uint8_t *block)
+{
+  return jbod_operation(op, block);
+}
+
+static bool local_has_extents(jbod_backend_t *be)
+{
+  return false;
+}
+
+static int local_flush(jbod_backend_t *be)
+{
+  return 0;
+}
+
+static int local_geometry(jbod_backend_t *be, jbod_geometry_t *geometry)
+{
+  *geometry = *jbod_geometry_default();
+  return 0;
+}
+
+static void local_set_deadline(jbod_backend_t *be, int64_t deadline_ns)
+{
+}
+
+static unsigned local_generation(jbod_backend_t *be)
+{
+  return 0;
+}
+
+/* jbod.o is a single global, so there is one local backend and nothing to free */
+static void local_close(jbod_backend_t *be)
+{
+}
+
+static const jbod_backend_ops_t local_ops = {
+  .name = "local",
+  .operation = local_operation,
+  .has_extents = local_has_extents,
+  .flush = local_flush,
+  .geometry = local_geometry,
+  .set_deadline = local_set_deadline,
+  .generation = local_generation,
+  .block_ptr = NULL,
+  .close = local_close,
+};
+
+static jbod_backend_t local_backend = { &local_ops };
+
+/* image: a memory-mapped file */
+
+typedef struct {
+  jbod_backend_t base;
+  uint8_t *map;
+  size_t size;
+  jbod_geometry_t geometry;
+  bool mounted;
+  /* the emulated JBOD position, for the single-block commands */
+  int disk;
+  int block;
+} image_backend_t;
+
+static uint8_t *image_block(image_backend_t *ib, int disk, int block)
+{
+  if (!ib->mounted || disk < 0 || block < 0 || (uint32_t)disk >= ib->geometry.num_disks ||
+      (uint32_t)block >= ib->geometry.blocks_per_disk)
+    return NULL;
+  return ib->map + (size_t)jbod_geometry_global(&ib->geometry, disk, block) * JBOD_BLOCK_SIZE;
+}
+
+/* behaves like the JBOD, including its errors, for the commands in jbod.h */
+static int image_operation(jbod_backend_t *be, uint32_t op, uint8_t *block)
+{
+  image_backend_t *ib = (image_backend_t *)be;
+  uint8_t *p;
+
+  switch (OP_CMD(op)) {
+    case JBOD_MOUNT:
+      if (ib->mounted)
+        return -1;
+      ib->mounted = true;
+      ib->disk = ib->block = 0;
+      return 0;
+    case JBOD_UNMOUNT:
+      if (!ib->mounted)
+        return -1;
+      ib->mounted = false;
+      return 0;
+    case JBOD_SEEK_TO_DISK:
+      if (!image_block(ib, OP_DISK(op), 0))
+        return -1;
+      ib->disk = OP_DISK(op);
+      ib->block = 0;
+      return 0;
+    case JBOD_SEEK_TO_BLOCK:
+      if (!image_block(ib, ib->disk, OP_BLOCK(op)))
+        return -1;
+      ib->block = OP_BLOCK(op);
+      return 0;
+    case JBOD_READ_BLOCK:
+    case JBOD_WRITE_BLOCK:
+      if (!block || !(p = image_block(ib, ib->disk, ib->block)))
+        return -1;
+      if (OP_CMD(op) == JBOD_READ_BLOCK)
+        memcpy(block, p, JBOD_BLOCK_SIZE);
+      else
+        memcpy(p, block, JBOD_BLOCK_SIZE);
+      ib->block++;
+      return 0;
+    case JBOD_SIGN_BLOCK:
+      if (!block || !(p = image_block(ib, OP_DISK(op), OP_BLOCK(op))))
+        return -1;
+      snprintf((char *)block, JBOD_BLOCK_SIZE, "SIG(disk,block) %2d %3d : %s\n", OP_DISK(op), OP_BLOCK(op),
+               sha1_sig(p, JBOD_BLOCK_SIZE));
+      return 0;
+    default:
+      return -1;
+  }
+}
+
+static bool image_has_extents(jbod_backend_t *be)
+{
+  return true;
+}
+
+static uint8_t *image_extent(image_backend_t *ib, int disk, int block, int count)
+{
+  if (count <= 0 || !image_block(ib, disk, block + count - 1))
+    return NULL;
+  ib->disk = disk;
+  ib->block = block + count;
+  return image_block(ib, disk, block);
+}
+
+static int image_read_extent(jbod_backend_t *be, int disk, int block, int count, uint8_t *buf)
+{
+  uint8_t *p = image_extent((image_backend_t *)be, disk, block, count);
+  if (!p)
+    return -1;
+  memcpy(buf, p, (size_t)count * JBOD_BLOCK_SIZE);
+  return 0;
+}
+
+static int image_write_extent(jbod_backend_t *be, int disk, int block, int count, const uint8_t *buf)
+{
+  uint8_t *p = image_extent((image_backend_t *)be, disk, block, count);
+  if (!p)
+    return -1;
+  memcpy(p, buf, (size_t)count * JBOD_BLOCK_SIZE);
+  return 0;
+}
+
+static int image_flush(jbod_backend_t *be)
+{
+  image_backend_t *ib = (image_backend_t *)be;
+  return msync(ib->map, ib->size, MS_SYNC);
+}
+
+static int image_geometry(jbod_backend_t *be, jbod_geometry_t *geometry)
+{
+  *geometry = ((image_backend_t *)be)->geometry;
+  return 0;
+}
+
+static void image_set_deadline(jbod_backend_t *be, int64_t deadline_ns)
+{
+}
+
+static unsigned image_generation(jbod_backend_t *be)
+{
+  return 0;
+}
+
+static const uint8_t *image_block_ptr(jbod_backend_t *be, int disk, int block)
+{
+  return image_block((image_backend_t *)be, disk, block);
+}
+
+static void image_close(jbod_backend_t *be)
+{
+  image_backend_t *ib = (image_backend_t *)be;
+  msync(ib->map, ib->size, MS_SYNC);
+  munmap(ib->map, ib->size);
+  free(ib);
+}
+
+static const jbod_backend_ops_t image_ops = {
+  .name = "image",
+  .operation = image_operation,
+  .has_extents = image_has_extents,
+  .read_extent = image_read_extent,
+  .write_extent = image_write_extent,
+  .flush = image_flush,
+  .geometry = image_geometry,
+  .set_deadline = image_set_deadline,
+  .generation = image_generation,
+  .block_ptr = image_block_ptr,
+  .close = image_close,
+};
+
+/* maps the image at path, sized for geometry if it is not NULL */
+static jbod_backend_t *image_open(const char *path, const jbod_geometry_t *geometry)
+{
+  int fd = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+  if (fd == -1)
+    return NULL;
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return NULL;
+  }
+
+  image_backend_t *ib = calloc(1, sizeof(image_backend_t));
+  if (!ib) {
+    close(fd);
+    return NULL;
+  }
+  ib->base.ops = &image_ops;
+
+  /* without a geometry, an existing image keeps the whole disks it has */
+  size_t diskSize = (size_t)JBOD_NUM_BLOCKS_PER_DISK * JBOD_BLOCK_SIZE;
+  if (geometry)
+    ib->geometry = *geometry;
+  else if (st.st_size < (off_t)diskSize ||
+           jbod_geometry_init(&ib->geometry, st.st_size / diskSize, JBOD_NUM_BLOCKS_PER_DISK) != 1)
+    ib->geometry = *jbod_geometry_default();
+
+  ib->size = (size_t)jbod_geometry_blocks(&ib->geometry) * JBOD_BLOCK_SIZE;
+  if ((st.st_size < (off_t)ib->size && ftruncate(fd, ib->size) == -1) ||
+      (ib->map = mmap(NULL, ib->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    close(fd);
+    free(ib);
+    return NULL;
+  }
+  close(fd);
+  return &ib->base;
+}
+
+jbod_backend_t *jbod_backend_open(const char *spec)
+{
+  char buf[256];
+  snprintf(buf, sizeof(buf), "%s", spec);
+
+  if (strcmp(buf, "net") == 0)
+    return jbod_backend_net_open(JBOD_SERVER, JBOD_PORT);
+  if (strncmp(buf, "net:", 4) == 0) {
+    char *port = strrchr(buf + 4, ':');
+    if (!port)
+      return NULL;
+    *port++ = '\0';
+    return jbod_backend_net_open(buf + 4, atoi(port));
+  }
+  if (strcmp(buf, "local") == 0)
+    return &local_backend;
+  if (strncmp(buf, "image:", 6) == 0) {
+    jbod_geometry_t geometry;
+    unsigned disks, blocks;
+    char *shape = strrchr(buf + 6, ':');
+    if (shape && sscanf(shape + 1, "%ux%u", &disks, &blocks) == 2) {
+      if (jbod_geometry_init(&geometry, disks, blocks) != 1)
+        return NULL;
+      *shape = '\0';
+      return image_open(buf + 6, &geometry);
+    }
+    return image_open(buf + 6, NULL);
+  }
+  return NULL;
+}
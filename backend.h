@@ -0,0 +1,73 @@
+#ifndef BACKEND_H_
+#define BACKEND_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "jbod.h"
+#include "geometry.h"
+#include "net.h"
+
+/* Where mdadm's block operations go. A backend takes JBOD commands, and
+ * optionally whole extents, from one context at a time:
+ *
+ *   net   - a JBOD server, over a jbod_conn_t (net.h)
+ *   local - jbod.o's jbod_operation, in this process
+ *   image - a file mapped into memory, laid out disk after disk, whose
+ *           blocks can be read in place through block_ptr */
+typedef struct jbod_backend jbod_backend_t;
+
+typedef struct {
+  const char *name;
+  /* runs one JBOD command as jbod_operation does; 0 on success, -1 on failure */
+  int (*operation)(jbod_backend_t *be, uint32_t op, uint8_t *block);
+  /* whether read_extent and write_extent may be used right now */
+  bool (*has_extents)(jbod_backend_t *be);
+  /* move |count| blocks of one disk starting at |disk|/|block|, leaving the
+   * JBOD just past them; 0 on success, -1 on failure */
+  int (*read_extent)(jbod_backend_t *be, int disk, int block, int count, uint8_t *buf);
+  int (*write_extent)(jbod_backend_t *be, int disk, int block, int count, const uint8_t *buf);
+  /* makes the writes done so far durable; 0 on success, -1 on failure */
+  int (*flush)(jbod_backend_t *be);
+  /* the shape of the array once mounted; 0 on success, -1 on failure */
+  int (*geometry)(jbod_backend_t *be, jbod_geometry_t *geometry);
+  /* bounds every later command by an absolute CLOCK_MONOTONIC deadline, 0 for none */
+  void (*set_deadline)(jbod_backend_t *be, int64_t deadline_ns);
+  /* changes whenever the backend may have lost the JBOD's seek position */
+  unsigned (*generation)(jbod_backend_t *be);
+  /* the bytes of a mounted block, valid until unmount; NULL when the backend
+   * cannot hand out its blocks (this member may itself be NULL) */
+  const uint8_t *(*block_ptr)(jbod_backend_t *be, int disk, int block);
+  void (*close)(jbod_backend_t *be);
+} jbod_backend_ops_t;
+
+/* every backend starts with this, followed by its own state */
+struct jbod_backend {
+  const jbod_backend_ops_t *ops;
+};
+
+/* Returns a backend described by |spec|, or NULL on failure:
+ *
+ *   net                        the server at JBOD_SERVER:JBOD_PORT
+ *   net:IP:PORT                another server
+ *   local                      jbod.o in this process
+ *   image:PATH[:DISKSxBLOCKS]  the image file at PATH, created or grown to
+ *                              the given geometry (default: the one in
+ *                              jbod.h, or as many whole disks as the file
+ *                              already holds) */
+jbod_backend_t *jbod_backend_open(const char *spec);
+
+/* Returns a net backend on its own new connection to |ip|:|port|, or NULL. */
+jbod_backend_t *jbod_backend_net_open(const char *ip, uint16_t port);
+
+/* Returns the net backend on the connection set up by jbod_connect. It is
+ * never closed. */
+jbod_backend_t *jbod_backend_default(void);
+
+static inline void jbod_backend_close(jbod_backend_t *be)
+{
+  if (be)
+    be->ops->close(be);
+}
+
+#endif
@@ -3,36 +3,777 @@
 #include <stdio.h>
 
 #include "cache.h"
+#include "sketch.h"
+#include "mrc.h"
+#include "shcache.h"
+#include "trace.h"
 
-static cache_entry_t *cache = NULL;
-static int cache_size = 0;
-static int clock = 0;
-static int num_queries = 0;
-static int num_hits = 0;
+#define CACHE_MIN_ENTRIES 2
+#define CACHE_MAX_ENTRIES 4096
+
+/* entries per payload slot; blocks with the same contents share a payload, so
+ * redundant data fits this many times more blocks in the same payload memory */
+#define ENTRIES_PER_PAYLOAD 4
+
+/* share of the payloads given to the admission window, in percent */
+#define ADMISSION_WINDOW_PERCENT 1
+
+/* the recency lists, indexed by cache_entry_t.in_window */
+#define MAIN 0
+#define WINDOW 1
+
+struct cache {
+  cache_entry_t *entries;
+  int size;
+  int clock;
+  int num_queries;
+  int num_hits;
+  /* hash chains of the valid entries, -1 terminated; the number of buckets is a power of two */
+  int *bucket;
+  int *chain;
+  uint32_t bucket_mask;
+  /* recency lists threaded through the entries, most recent at the head, -1 terminated */
+  int *prev;
+  int *next;
+  int head[2];
+  int tail[2];
+  int count[2];
+  /* indexes of the invalid entries */
+  int *free_slots;
+  int num_free;
+  /* TinyLFU admission, see cache_set_admission */
+  bool admission;
+  sketch_t sketch;
+  int window_size;
+  /* key of the last lookup that missed, which the insert that follows it should not count again */
+  int64_t last_miss;
+  /* reuse distances of the lookups, for sizing the cache */
+  mrc_t mrc;
+  /* content-addressed payload pool the entries point into, with its own hash chains keyed by content hash */
+  uint8_t *payloads;
+  int pool_size;
+  int *refs;
+  /* borrowed references handed out by cache_ctx_lookup_pinned; a pinned payload is never rewritten or reused */
+  int *pins;
+  uint64_t *content;
+  int *pbucket;
+  int *pchain;
+  uint32_t pbucket_mask;
+  int *free_payloads;
+  int num_free_payloads;
+  /* set instead of entries when the blocks live in a shared segment, see cache_create_shared */
+  shcache_t *shared;
+  /* write count when the last lookup missed, which the fill that follows has to match */
+  uint64_t fill_token;
+};
+
+static cache_t default_cache;
+
+/* the cache does not know the array's geometry, so any disk and block will do */
+static bool valid_block(int disk_num, int block_num) {
+  return disk_num >= 0 && block_num >= 0;
+}
+
+static uint64_t block_key(int disk_num, int block_num) {
+  return ((uint64_t)disk_num << 32) | (uint32_t)block_num;
+}
+
+static uint32_t bucket_of(cache_t *c, int disk_num, int block_num) {
+  return mix64(block_key(disk_num, block_num)) & c->bucket_mask;
+}
+
+static cache_entry_t *find_entry(cache_t *c, int disk_num, int block_num) {
+  if (!valid_block(disk_num, block_num))
+    return NULL;
+  for (int i = c->bucket[bucket_of(c, disk_num, block_num)]; i != -1; i = c->chain[i]) {
+    cache_entry_t *e = &c->entries[i];
+    if (e->disk_num == disk_num && e->block_num == block_num)
+      return e;
+  }
+  return NULL;
+}
+
+static void hash_add(cache_t *c, int i) {
+  uint32_t b = bucket_of(c, c->entries[i].disk_num, c->entries[i].block_num);
+  c->chain[i] = c->bucket[b];
+  c->bucket[b] = i;
+}
+
+static void hash_remove(cache_t *c, int i) {
+  int *link = &c->bucket[bucket_of(c, c->entries[i].disk_num, c->entries[i].block_num)];
+  while (*link != i)
+    link = &c->chain[*link];
+  *link = c->chain[i];
+}
+
+static void list_remove(cache_t *c, int i) {
+  int list = c->entries[i].in_window;
+  if (c->prev[i] != -1)
+    c->next[c->prev[i]] = c->next[i];
+  else
+    c->head[list] = c->next[i];
+  if (c->next[i] != -1)
+    c->prev[c->next[i]] = c->prev[i];
+  else
+    c->tail[list] = c->prev[i];
+  c->count[list]--;
+}
+
+static void list_push(cache_t *c, int i) {
+  int list = c->entries[i].in_window;
+  c->prev[i] = -1;
+  c->next[i] = c->head[list];
+  if (c->head[list] != -1)
+    c->prev[c->head[list]] = i;
+  else
+    c->tail[list] = i;
+  c->head[list] = i;
+  c->count[list]++;
+}
+
+/* puts entry |i| at the cold end of its list, next in line for eviction */
+static void list_append(cache_t *c, int i) {
+  int list = c->entries[i].in_window;
+  c->next[i] = -1;
+  c->prev[i] = c->tail[list];
+  if (c->tail[list] != -1)
+    c->next[c->tail[list]] = i;
+  else
+    c->head[list] = i;
+  c->tail[list] = i;
+  c->count[list]++;
+}
+
+static void touch(cache_t *c, int i) {
+  list_remove(c, i);
+  list_push(c, i);
+  c->entries[i].access_time = ++c->clock;
+}
+
+static uint64_t content_hash(const uint8_t *buf) {
+  uint64_t h = 0x9e3779b97f4a7c15ULL;
+  for (int i = 0; i < JBOD_BLOCK_SIZE; i += 8) {
+    uint64_t w;
+    memcpy(&w, buf + i, 8);
+    h = ((h ^ w) * 0xff51afd7ed558ccdULL);
+    h = (h << 31) | (h >> 33);
+  }
+  return mix64(h);
+}
+
+static uint8_t *payload(cache_t *c, int p) {
+  return c->payloads + (size_t)p * JBOD_BLOCK_SIZE;
+}
+
+static int payload_find(cache_t *c, const uint8_t *buf, uint64_t h) {
+  for (int p = c->pbucket[h & c->pbucket_mask]; p != -1; p = c->pchain[p])
+    if (c->content[p] == h && memcmp(payload(c, p), buf, JBOD_BLOCK_SIZE) == 0)
+      return p;
+  return -1;
+}
+
+static void payload_hash_add(cache_t *c, int p) {
+  int *head = &c->pbucket[c->content[p] & c->pbucket_mask];
+  c->pchain[p] = *head;
+  *head = p;
+}
+
+static void payload_hash_remove(cache_t *c, int p) {
+  int *link = &c->pbucket[c->content[p] & c->pbucket_mask];
+  while (*link != p)
+    link = &c->pchain[*link];
+  *link = c->pchain[p];
+}
+
+static void payload_release(cache_t *c, int p) {
+  if (--c->refs[p] > 0 || c->pins[p] > 0)
+    return;
+  payload_hash_remove(c, p);
+  c->free_payloads[c->num_free_payloads++] = p;
+}
+
+/* drops entry |i|, which must be valid, and returns its index */
+static int evict(cache_t *c, int i) {
+  cache_entry_t *e = &c->entries[i];
+  list_remove(c, i);
+  hash_remove(c, i);
+  payload_release(c, e->payload);
+  e->valid = false;
+  return i;
+}
+
+/* moves entry |i| from the admission window to the head of the main region */
+static void promote(cache_t *c, int i) {
+  list_remove(c, i);
+  c->entries[i].in_window = false;
+  list_push(c, i);
+}
+
+/* TinyLFU's duel: the window's LRU block moves to the main region if the
+ * sketch says it is used more often than the main region's LRU block. Returns
+ * the loser, the one to evict, or -1 if both regions are empty. */
+static int duel(cache_t *c) {
+  int candidate = c->tail[WINDOW], victim = c->tail[MAIN];
+  if (candidate == -1 || victim == -1)
+    return candidate == -1 ? victim : candidate;
+  cache_entry_t *ce = &c->entries[candidate], *ve = &c->entries[victim];
+  if (sketch_estimate(&c->sketch, block_key(ce->disk_num, ce->block_num)) >
+      sketch_estimate(&c->sketch, block_key(ve->disk_num, ve->block_num))) {
+    promote(c, candidate);
+    return victim;
+  }
+  return candidate;
+}
+
+/* returns a payload holding |buf| with a reference taken for the caller,
+ * sharing an existing one with the same contents if there is one. When every
+ * payload slot is in use, entries are dropped until one frees up: the least
+ * recently used, or with admission on and the window full, the loser of the
+ * duel, since payloads rather than entries are what runs out with unique
+ * data. Returns -1 if pinned payloads fill the whole pool. */
+static int payload_intern(cache_t *c, const uint8_t *buf) {
+  uint64_t h = content_hash(buf);
+  int p = payload_find(c, buf, h);
+  if (p != -1) {
+    c->refs[p]++;
+    return p;
+  }
+  while (c->num_free_payloads == 0) {
+    int victim;
+    if (c->admission && c->count[WINDOW] >= c->window_size)
+      victim = duel(c);
+    else
+      victim = c->tail[MAIN] != -1 ? c->tail[MAIN] : c->tail[WINDOW];
+    if (victim == -1)
+      return -1;
+    c->free_slots[c->num_free++] = evict(c, victim);
+  }
+  p = c->free_payloads[--c->num_free_payloads];
+  memcpy(payload(c, p), buf, JBOD_BLOCK_SIZE);
+  c->content[p] = h;
+  c->refs[p] = 1;
+  payload_hash_add(c, p);
+  return p;
+}
+
+/* points valid entry |i| at |buf|'s contents. A payload the entry owns alone
+ * is rewritten in place; one it shares, or that is pinned, is left as it is
+ * (copy on write). Returns false if the entry had to be dropped because
+ * pinned payloads left no room. */
+static bool set_payload(cache_t *c, int i, const uint8_t *buf) {
+  cache_entry_t *e = &c->entries[i];
+  int old = e->payload;
+  if (memcmp(payload(c, old), buf, JBOD_BLOCK_SIZE) == 0)
+    return true;
+
+  uint64_t h = content_hash(buf);
+  if (c->refs[old] == 1 && c->pins[old] == 0 && payload_find(c, buf, h) == -1) {
+    payload_hash_remove(c, old);
+    memcpy(payload(c, old), buf, JBOD_BLOCK_SIZE);
+    c->content[old] = h;
+    payload_hash_add(c, old);
+    return true;
+  }
+
+  /* off the lists, the entry cannot be one of the evictions payload_intern makes */
+  list_remove(c, i);
+  payload_release(c, old);
+  e->payload = payload_intern(c, buf);
+  if (e->payload == -1) {
+    hash_remove(c, i);
+    e->valid = false;
+    c->free_slots[c->num_free++] = i;
+    return false;
+  }
+  list_push(c, i);
+  return true;
+}
+
+static void reset_lists(cache_t *c) {
+  for (int list = MAIN; list <= WINDOW; ++list) {
+    c->head[list] = c->tail[list] = -1;
+    c->count[list] = 0;
+  }
+}
+
+static void free_arrays(cache_t *c) {
+  free(c->entries);
+  free(c->bucket);
+  free(c->chain);
+  free(c->prev);
+  free(c->next);
+  free(c->free_slots);
+  free(c->payloads);
+  free(c->refs);
+  free(c->pins);
+  free(c->content);
+  free(c->pbucket);
+  free(c->pchain);
+  free(c->free_payloads);
+  c->entries = NULL;
+}
+
+static uint32_t buckets_for(int n) {
+  uint32_t num_buckets = 1;
+  while (num_buckets < (uint32_t)n)
+    num_buckets <<= 1;
+  return num_buckets;
+}
+
+static int cache_init(cache_t *c, int num_payloads) {
+  if (c->entries || num_payloads < CACHE_MIN_ENTRIES || num_payloads > CACHE_MAX_ENTRIES)
+    return -1;
+  int num_entries = num_payloads * ENTRIES_PER_PAYLOAD;
+  /* at least as many buckets as entries keeps the chains short */
+  uint32_t num_buckets = buckets_for(num_entries), num_pbuckets = buckets_for(num_payloads);
+  c->entries = calloc(num_entries, sizeof(cache_entry_t));
+  c->bucket = malloc(num_buckets * sizeof(int));
+  c->chain = calloc(num_entries, sizeof(int));
+  c->prev = calloc(num_entries, sizeof(int));
+  c->next = calloc(num_entries, sizeof(int));
+  c->free_slots = calloc(num_entries, sizeof(int));
+  c->payloads = malloc((size_t)num_payloads * JBOD_BLOCK_SIZE);
+  c->refs = calloc(num_payloads, sizeof(int));
+  c->pins = calloc(num_payloads, sizeof(int));
+  c->content = calloc(num_payloads, sizeof(uint64_t));
+  c->pbucket = malloc(num_pbuckets * sizeof(int));
+  c->pchain = calloc(num_payloads, sizeof(int));
+  c->free_payloads = calloc(num_payloads, sizeof(int));
+  if (!c->entries || !c->bucket || !c->chain || !c->prev || !c->next || !c->free_slots || !c->payloads ||
+      !c->refs || !c->pins || !c->content || !c->pbucket || !c->pchain || !c->free_payloads) {
+    free_arrays(c);
+    return -1;
+  }
+  c->size = num_entries;
+  c->pool_size = num_payloads;
+  c->clock = 0;
+  c->bucket_mask = num_buckets - 1;
+  for (uint32_t b = 0; b < num_buckets; ++b)
+    c->bucket[b] = -1;
+  c->pbucket_mask = num_pbuckets - 1;
+  for (uint32_t b = 0; b < num_pbuckets; ++b)
+    c->pbucket[b] = -1;
+  for (int p = 0; p < num_payloads; ++p)
+    c->free_payloads[p] = num_payloads - 1 - p;
+  c->num_free_payloads = num_payloads;
+  reset_lists(c);
+  /* handed out from the end, so entry 0 goes first */
+  for (int i = 0; i < num_entries; ++i)
+    c->free_slots[i] = num_entries - 1 - i;
+  c->num_free = num_entries;
+  c->last_miss = -1;
+  mrc_reset(&c->mrc);
+  return 1;
+}
+
+static int cache_init_shared(cache_t *c, const char *name, int num_entries) {
+  if (c->entries || c->shared || !name || num_entries < CACHE_MIN_ENTRIES || num_entries > CACHE_MAX_ENTRIES)
+    return -1;
+  c->shared = shcache_open(name, num_entries);
+  if (!c->shared)
+    return -1;
+  c->size = shcache_size(c->shared);
+  c->last_miss = -1;
+  mrc_reset(&c->mrc);
+  return 1;
+}
+
+static int cache_fini(cache_t *c) {
+  if (c->shared) {
+    shcache_close(c->shared);
+    c->shared = NULL;
+    c->size = 0;
+    return 1;
+  }
+  if (!c->entries)
+    return -1;
+  if (c->admission)
+    sketch_free(&c->sketch);
+  c->admission = false;
+  free_arrays(c);
+  c->size = 0;
+  return 1;
+}
+
+cache_t *cache_default(void) {
+  return &default_cache;
+}
+
+cache_t *cache_ctx_create(int num_entries) {
+  cache_t *c = calloc(1, sizeof(cache_t));
+  if (!c)
+    return NULL;
+  if (cache_init(c, num_entries) != 1) {
+    free(c);
+    return NULL;
+  }
+  return c;
+}
+
+cache_t *cache_ctx_create_shared(const char *name, int num_entries) {
+  cache_t *c = calloc(1, sizeof(cache_t));
+  if (!c)
+    return NULL;
+  if (cache_init_shared(c, name, num_entries) != 1) {
+    free(c);
+    return NULL;
+  }
+  return c;
+}
+
+int cache_ctx_destroy(cache_t *cache) {
+  if (!cache || cache == &default_cache)
+    return -1;
+  cache_fini(cache);
+  free(cache);
+  return 1;
+}
+
+static int lookup(cache_t *cache, int disk_num, int block_num, uint8_t *buf) {
+  if (!cache_ctx_enabled(cache) || !buf || !valid_block(disk_num, block_num))
+    return -1;
+
+  cache->num_queries++;
+  mrc_access(&cache->mrc, disk_num, block_num);
+  if (cache->shared) {
+    if (!shcache_lookup(cache->shared, block_key(disk_num, block_num), buf)) {
+      cache->fill_token = shcache_token(cache->shared);
+      return -1;
+    }
+    cache->num_hits++;
+    return 1;
+  }
+  if (cache->admission)
+    sketch_increment(&cache->sketch, block_key(disk_num, block_num));
+
+  cache_entry_t *e = find_entry(cache, disk_num, block_num);
+  if (!e) {
+    cache->last_miss = block_key(disk_num, block_num);
+    return -1;
+  }
+
+  cache->num_hits++;
+  touch(cache, e - cache->entries);
+  memcpy(buf, payload(cache, e->payload), JBOD_BLOCK_SIZE);
+  return 1;
+}
+
+static const uint8_t *lookup_pinned(cache_t *cache, int disk_num, int block_num) {
+  /* the shared segment's blocks can change under a reader, so they are never lent out */
+  if (!cache || !cache->entries || !valid_block(disk_num, block_num))
+    return NULL;
+
+  cache->num_queries++;
+  mrc_access(&cache->mrc, disk_num, block_num);
+  if (cache->admission)
+    sketch_increment(&cache->sketch, block_key(disk_num, block_num));
+
+  cache_entry_t *e = find_entry(cache, disk_num, block_num);
+  if (!e) {
+    cache->last_miss = block_key(disk_num, block_num);
+    return NULL;
+  }
+
+  cache->num_hits++;
+  touch(cache, e - cache->entries);
+  cache->pins[e->payload]++;
+  return payload(cache, e->payload);
+}
+
+/* the public operations are traced as spans with the block and the outcome */
+static void trace_block(const char *name, int disk_num, int block_num) {
+  trace_begin(name);
+  trace_arg("disk", disk_num);
+  trace_arg("block", block_num);
+}
+
+int cache_ctx_lookup(cache_t *cache, int disk_num, int block_num, uint8_t *buf) {
+  trace_block("cache_lookup", disk_num, block_num);
+  int rc = lookup(cache, disk_num, block_num, buf);
+  trace_arg("hit", rc == 1);
+  trace_end();
+  return rc;
+}
+
+const uint8_t *cache_ctx_lookup_pinned(cache_t *cache, int disk_num, int block_num) {
+  trace_block("cache_lookup_pinned", disk_num, block_num);
+  const uint8_t *block = lookup_pinned(cache, disk_num, block_num);
+  trace_arg("hit", block != NULL);
+  trace_end();
+  return block;
+}
+
+void cache_ctx_unpin(cache_t *cache, const uint8_t *block) {
+  if (!cache || !cache->entries || !block)
+    return;
+  int p = (block - cache->payloads) / JBOD_BLOCK_SIZE;
+  if (p < 0 || p >= cache->pool_size || cache->pins[p] == 0)
+    return;
+  /* a payload that lost its last entry while pinned is freed now */
+  if (--cache->pins[p] == 0 && cache->refs[p] == 0) {
+    cache->refs[p] = 1;
+    payload_release(cache, p);
+  }
+}
+
+static void update(cache_t *cache, int disk_num, int block_num, const uint8_t *buf) {
+  if (!cache_ctx_enabled(cache) || !buf)
+    return;
+  /* another process may hold an older copy in flight, so a shared block is dropped instead */
+  if (cache->shared) {
+    cache_ctx_invalidate(cache, disk_num, block_num);
+    return;
+  }
+
+  cache_entry_t *e = find_entry(cache, disk_num, block_num);
+  if (!e)
+    return;
+
+  if (set_payload(cache, e - cache->entries, buf))
+    touch(cache, e - cache->entries);
+}
+
+/* picks the entry a new block goes into under TinyLFU. New blocks always
+ * enter the window; when it is full its LRU block moves to the main region if
+ * there is room, or duels the main region's LRU block, and the loser's entry
+ * is reused. payload_intern has already made room for the new block's
+ * payload, so this only runs out of entries when blocks share payloads. */
+static int admit(cache_t *c) {
+  if (c->count[WINDOW] < c->window_size && c->num_free > 0)
+    return c->free_slots[--c->num_free];
+
+  if (c->num_free > 0) {
+    if (c->tail[WINDOW] != -1 && c->count[MAIN] < c->size - c->window_size)
+      promote(c, c->tail[WINDOW]);
+    return c->free_slots[--c->num_free];
+  }
+  return evict(c, duel(c));
+}
+
+static int insert(cache_t *cache, int disk_num, int block_num, const uint8_t *buf) {
+  if (!cache_ctx_enabled(cache) || !buf || !valid_block(disk_num, block_num))
+    return -1;
+  if (cache->shared) {
+    shcache_insert(cache->shared, block_key(disk_num, block_num), buf, cache->fill_token);
+    return 1;
+  }
+
+  cache_entry_t *e = find_entry(cache, disk_num, block_num);
+  if (e) {
+    if (!set_payload(cache, e - cache->entries, buf))
+      return -1;
+    touch(cache, e - cache->entries);
+    return 1;
+  }
+
+  /* the payload comes first, since making room for it can free entries too */
+  int p = payload_intern(cache, buf);
+  if (p == -1)
+    return -1;
+  int i;
+  if (cache->admission) {
+    /* a block that was just looked up has already been counted */
+    int64_t key = block_key(disk_num, block_num);
+    if (cache->last_miss != key)
+      sketch_increment(&cache->sketch, key);
+    cache->last_miss = -1;
+    i = admit(cache);
+  } else if (cache->num_free > 0) {
+    i = cache->free_slots[--cache->num_free];
+  } else {
+    /* evicts the least recently used */
+    i = evict(cache, cache->tail[MAIN]);
+  }
+
+  e = &cache->entries[i];
+  e->valid = true;
+  e->in_window = cache->admission;
+  e->disk_num = disk_num;
+  e->block_num = block_num;
+  e->payload = p;
+  e->access_time = ++cache->clock;
+  hash_add(cache, i);
+  list_push(cache, i);
+  return 1;
+}
+
+void cache_ctx_update(cache_t *cache, int disk_num, int block_num, const uint8_t *buf) {
+  trace_block("cache_update", disk_num, block_num);
+  update(cache, disk_num, block_num, buf);
+  trace_end();
+}
+
+int cache_ctx_insert(cache_t *cache, int disk_num, int block_num, const uint8_t *buf) {
+  trace_block("cache_insert", disk_num, block_num);
+  int rc = insert(cache, disk_num, block_num, buf);
+  trace_arg("inserted", rc == 1);
+  trace_end();
+  return rc;
+}
+
+static int by_access_time(const void *a, const void *b) {
+  const cache_entry_t *x = *(cache_entry_t *const *)a, *y = *(cache_entry_t *const *)b;
+  return (x->access_time > y->access_time) - (x->access_time < y->access_time);
+}
+
+int cache_ctx_set_admission(cache_t *cache, bool enabled) {
+  if (!cache || !cache->entries || cache->shared)
+    return -1;
+  if (enabled == cache->admission)
+    return 1;
+
+  if (enabled) {
+    if (sketch_init(&cache->sketch, cache->size) != 1)
+      return -1;
+    /* with unique data the cache holds one block per payload, so the window is sized by those */
+    cache->window_size = cache->pool_size * ADMISSION_WINDOW_PERCENT / 100;
+    if (cache->window_size < 1)
+      cache->window_size = 1;
+  } else {
+    sketch_free(&cache->sketch);
+  }
+
+  /* whatever is cached now counts as main region, in its recency order */
+  cache_entry_t **valid = malloc(cache->size * sizeof(cache_entry_t *));
+  if (!valid)
+    return -1;
+  int n = 0;
+  for (int i = 0; i < cache->size; ++i)
+    if (cache->entries[i].valid)
+      valid[n++] = &cache->entries[i];
+  qsort(valid, n, sizeof(valid[0]), by_access_time);
+  reset_lists(cache);
+  for (int i = 0; i < n; ++i) {
+    valid[i]->in_window = false;
+    list_push(cache, valid[i] - cache->entries);
+  }
+  free(valid);
+
+  cache->admission = enabled;
+  cache->last_miss = -1;
+  return 1;
+}
+
+void cache_ctx_invalidate(cache_t *cache, int disk_num, int block_num) {
+  if (!cache_ctx_enabled(cache))
+    return;
+  if (cache->shared) {
+    if (valid_block(disk_num, block_num))
+      shcache_invalidate(cache->shared, block_key(disk_num, block_num));
+    return;
+  }
+
+  cache_entry_t *e = find_entry(cache, disk_num, block_num);
+  if (e)
+    cache->free_slots[cache->num_free++] = evict(cache, e - cache->entries);
+}
+
+bool cache_ctx_contains(cache_t *cache, int disk_num, int block_num) {
+  if (!cache_ctx_enabled(cache) || !valid_block(disk_num, block_num))
+    return false;
+  if (cache->shared) {
+    uint8_t buf[JBOD_BLOCK_SIZE];
+    if (shcache_lookup(cache->shared, block_key(disk_num, block_num), buf))
+      return true;
+    /* the insert that fills the block has to match the write count from before the fetch */
+    cache->fill_token = shcache_token(cache->shared);
+    return false;
+  }
+  return find_entry(cache, disk_num, block_num) != NULL;
+}
+
+void cache_ctx_demote(cache_t *cache, int disk_num, int block_num) {
+  /* the shared segment's eviction order belongs to every process, so it is left alone */
+  if (!cache || !cache->entries)
+    return;
+  cache_entry_t *e = find_entry(cache, disk_num, block_num);
+  if (e) {
+    list_remove(cache, e - cache->entries);
+    list_append(cache, e - cache->entries);
+  }
+}
+
+bool cache_ctx_enabled(cache_t *cache) {
+  return cache && (cache->entries != NULL || cache->shared != NULL);
+}
+
+bool cache_ctx_is_shared(cache_t *cache) {
+  return cache && cache->shared != NULL;
+}
+
+void cache_ctx_print_hit_rate(cache_t *cache) {
+  fprintf(stderr, "Hit rate: %5.1f%%\n", 100 * (float) cache->num_hits / cache->num_queries);
+  if (cache->shared) {
+    uint64_t lookups, hits;
+    shcache_stats(cache->shared, &lookups, &hits);
+    fprintf(stderr, "Shared hit rate: %5.1f%% (all processes)\n", 100 * (float) hits / lookups);
+  }
+}
+
+int cache_ctx_miss_ratio_curve(cache_t *cache, cache_mrc_point_t *points, int num_points) {
+  if (!cache || !points || num_points < 0)
+    return -1;
+  mrc_estimate(&cache->mrc, points, num_points);
+  return 1;
+}
+
+void cache_ctx_print_miss_ratio_curve(cache_t *cache) {
+  cache_mrc_point_t points[16];
+  int n = 0;
+  for (int entries = CACHE_MIN_ENTRIES; entries <= CACHE_MAX_ENTRIES; entries *= 2)
+    points[n++].entries = entries;
+  mrc_estimate(&cache->mrc, points, n);
+
+  fprintf(stderr, "Estimated hit rate by cache size:\n");
+  for (int i = 0; i < n; ++i)
+    fprintf(stderr, "  %5d entries: %5.1f%%, cost saved %llu\n", points[i].entries,
+            100 * points[i].hit_rate, (unsigned long long)points[i].cost_saved);
+}
 
 int cache_create(int num_entries) {
-  return -10;
+  return cache_init(&default_cache, num_entries);
+}
+
+int cache_create_shared(const char *name, int num_entries) {
+  return cache_init_shared(&default_cache, name, num_entries);
+}
+
+int cache_remove_shared(const char *name) {
+  return name && shcache_unlink(name) == 0 ? 1 : -1;
 }
 
 int cache_destroy(void) {
-  return -10;
+  return cache_fini(&default_cache);
 }
 
 int cache_lookup(int disk_num, int block_num, uint8_t *buf) {
-  return -10;
+  return cache_ctx_lookup(&default_cache, disk_num, block_num, buf);
 }
 
 void cache_update(int disk_num, int block_num, const uint8_t *buf) {
+  cache_ctx_update(&default_cache, disk_num, block_num, buf);
 }
 
 int cache_insert(int disk_num, int block_num, const uint8_t *buf) {
-  return -10;
+  return cache_ctx_insert(&default_cache, disk_num, block_num, buf);
 }
 
 bool cache_enabled(void) {
-  return false;
+  return cache_ctx_enabled(&default_cache);
+}
+
+int cache_set_admission(bool enabled) {
+  return cache_ctx_set_admission(&default_cache, enabled);
 }
 
 void cache_print_hit_rate(void) {
-  fprintf(stderr, "Hit rate: %5.1f%%\n", 100 * (float) num_hits / num_queries);
+  cache_ctx_print_hit_rate(&default_cache);
+}
+
+int cache_miss_ratio_curve(cache_mrc_point_t *points, int num_points) {
+  return cache_ctx_miss_ratio_curve(&default_cache, points, num_points);
+}
+
+void cache_print_miss_ratio_curve(void) {
+  cache_ctx_print_miss_ratio_curve(&default_cache);
 }
@@ -6,20 +6,46 @@
 
 #include "jbod.h"
 #include "util.h"
+#include "mrc.h"
 
 typedef struct {
   bool valid;
   int disk_num;
   int block_num;
-  uint8_t block[JBOD_BLOCK_SIZE];
+  int payload;     /* the block's contents, in the cache's payload pool */
   int access_time;
+  bool in_window;  /* admission window rather than main region, see cache_set_admission */
 } cache_entry_t;
 
+/* An independent block cache. Every mdadm context owns one of these; the
+ * cache_* functions below operate on a process-wide default instance. */
+typedef struct cache cache_t;
+
 /* Returns 1 on success and -1 on failure. Should allocate a space for
- * |num_entries| cache entries, each of type cache_entry_t. Calling it again
+ * |num_entries| block payloads and four times as many cache entries, each
+ * of type cache_entry_t. Blocks with the same contents share one payload
+ * (found by a 64-bit content hash and confirmed byte for byte), so up to
+ * four times as many blocks fit when the data repeats; with nothing
+ * repeated it holds |num_entries| blocks, as before. Calling it again
  * without first calling cache_destroy (see below) should fail. */
 int cache_create(int num_entries);
 
+/* Returns 1 on success and -1 on failure. Like cache_create, but the
+ * entries live in the POSIX shared memory segment |name| (e.g.
+ * "/mdadm-cache") and are shared with every process that uses the same
+ * name, so a block fetched by one is a hit for all. The first process
+ * creates the segment with |num_entries| entries; later ones use it as it
+ * is. Lookups take no lock and eviction is CLOCK rather than LRU; TinyLFU
+ * admission is not available. Inserts are only fills after a missed lookup
+ * and are dropped if any process invalidated a block in the meantime, so
+ * writers invalidate (see cache_ctx_invalidate) rather than insert. The
+ * segment outlives the processes until cache_remove_shared. */
+int cache_create_shared(const char *name, int num_entries);
+
+/* Returns 1 on success and -1 on failure. Removes the name of a shared
+ * cache segment; processes that have it open keep using it. */
+int cache_remove_shared(const char *name);
+
 /* Returns 1 on success and -1 on failure. Frees the space allocated by
  * cache_create function above. */
 int cache_destroy(void);
@@ -44,4 +70,81 @@ bool cache_enabled(void);
 /* Prints the hit rate of the cache. */
 void cache_print_hit_rate(void);
 
+/* Returns 1 on success and -1 on failure. Turns the TinyLFU admission
+ * policy on or off. With it on, a small LRU window (1% of the |num_entries|
+ * payloads given to cache_create, at least one block) takes every new block;
+ * when the window overflows while the cache is out of payloads or entries,
+ * its least recently used block is admitted to the main region only if a
+ * frequency sketch says it is used more often than the block it would evict
+ * there. One-off blocks from scans then pass through the window without
+ * pushing popular blocks out. cache_insert still returns 1 for a block that
+ * ends up not being admitted. */
+int cache_set_admission(bool enabled);
+
+/* An estimate of the hit rate an LRU cache of |entries| entries would have
+ * had on the lookups seen so far, and the JBOD cost its hits would have
+ * saved. */
+typedef mrc_point_t cache_mrc_point_t;
+
+/* Returns 1 on success and -1 on failure. Fills in the estimates for the
+ * sizes given in the entries field of each of the |num_points| points. The
+ * estimates come from a sampled reuse-distance histogram the cache keeps
+ * across all lookups, whatever its own size; they are reset by
+ * cache_create. */
+int cache_miss_ratio_curve(cache_mrc_point_t *points, int num_points);
+
+/* Prints the estimates for every power-of-two cache size from 2 to 4096. */
+void cache_print_miss_ratio_curve(void);
+
+/* Returns the process-wide cache used by the functions above. It stays
+ * disabled until cache_create is called. */
+cache_t *cache_default(void);
+
+/* Returns a new cache with |num_entries| entries, or NULL on failure. A cache
+ * is not internally locked; its owner serializes access to it. */
+cache_t *cache_ctx_create(int num_entries);
+
+/* Returns a new handle on the shared cache |name| (see cache_create_shared),
+ * or NULL on failure. */
+cache_t *cache_ctx_create_shared(const char *name, int num_entries);
+
+/* Returns 1 on success and -1 on failure. Frees a cache returned by
+ * cache_ctx_create or cache_ctx_create_shared. */
+int cache_ctx_destroy(cache_t *cache);
+
+/* Same as the functions above, on an explicit cache. */
+int cache_ctx_lookup(cache_t *cache, int disk_num, int block_num, uint8_t *buf);
+int cache_ctx_insert(cache_t *cache, int disk_num, int block_num, const uint8_t *buf);
+void cache_ctx_update(cache_t *cache, int disk_num, int block_num, const uint8_t *buf);
+bool cache_ctx_enabled(cache_t *cache);
+bool cache_ctx_is_shared(cache_t *cache);
+void cache_ctx_print_hit_rate(cache_t *cache);
+int cache_ctx_set_admission(cache_t *cache, bool enabled);
+int cache_ctx_miss_ratio_curve(cache_t *cache, cache_mrc_point_t *points, int num_points);
+void cache_ctx_print_miss_ratio_curve(cache_t *cache);
+
+/* Like cache_ctx_lookup, but instead of copying the block returns a
+ * read-only pointer to it in the cache's own storage, or NULL on a miss. The
+ * bytes stay put and unchanged until cache_ctx_unpin, whatever is inserted,
+ * updated or evicted meanwhile; an update to the block goes to a new
+ * payload. Every pin has to be released before the cache is destroyed.
+ * Shared caches do not lend out their blocks and always return NULL. */
+const uint8_t *cache_ctx_lookup_pinned(cache_t *cache, int disk_num, int block_num);
+
+/* Releases a pointer returned by cache_ctx_lookup_pinned. */
+void cache_ctx_unpin(cache_t *cache, const uint8_t *block);
+
+/* Drops the entry for |disk_num| and |block_num|, if any, e.g. when a write
+ * to it failed and the JBOD's copy is no longer known. */
+void cache_ctx_invalidate(cache_t *cache, int disk_num, int block_num);
+
+/* Returns whether the block is cached, without counting as a lookup or
+ * making it more recent. A miss in a shared cache takes the fill token for
+ * the cache_ctx_insert that follows, like a lookup. */
+bool cache_ctx_contains(cache_t *cache, int disk_num, int block_num);
+
+/* Moves the block, if cached, to the cold end of the cache so it is the next
+ * to be evicted, e.g. once a scan has read it. Shared caches ignore it. */
+void cache_ctx_demote(cache_t *cache, int disk_num, int block_num);
+
 #endif
@@ -0,0 +1,193 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cbt.h"
+
+#define CBT_MAGIC 0x43425431  /* "CBT1" */
+/* the header has a page to itself so it can be written out on its own */
+#define CBT_HEADER_SIZE 4096
+
+typedef struct {
+  uint32_t magic;
+  uint32_t num_blocks;
+  uint32_t first_epoch;  /* oldest epoch whose bitmap is kept */
+  uint32_t epoch;        /* epoch being marked now */
+  uint32_t clean;        /* the bitmaps on disk hold every mark */
+} cbt_header_t;
+
+struct cbt {
+  uint8_t *map;
+  size_t size;
+  cbt_header_t *hdr;
+  uint32_t words;  /* per bitmap */
+};
+
+static uint64_t *bitmap(const cbt_t *cbt, uint32_t epoch)
+{
+  return (uint64_t *)(cbt->map + CBT_HEADER_SIZE) + (size_t)(epoch % CBT_EPOCHS) * cbt->words;
+}
+
+static void set_range(uint64_t *bits, uint32_t first, uint32_t count)
+{
+  for (uint32_t b = first; b < first + count; b++)
+    bits[b / 64] |= (uint64_t)1 << (b % 64);
+}
+
+cbt_t *cbt_open(const char *path, uint32_t num_blocks)
+{
+  if (num_blocks == 0)
+    return NULL;
+  int fd = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+  if (fd == -1)
+    return NULL;
+  struct stat st;
+  cbt_header_t old;
+  if (fstat(fd, &st) == -1 || (st.st_size >= (off_t)sizeof(old) && pread(fd, &old, sizeof(old), 0) != sizeof(old))) {
+    close(fd);
+    return NULL;
+  }
+  if (st.st_size < (off_t)sizeof(old))
+    memset(&old, 0, sizeof(old));
+
+  cbt_t *cbt = calloc(1, sizeof(cbt_t));
+  if (!cbt) {
+    close(fd);
+    return NULL;
+  }
+  cbt->words = (num_blocks + 63) / 64;
+  cbt->size = CBT_HEADER_SIZE + (size_t)CBT_EPOCHS * cbt->words * sizeof(uint64_t);
+
+  /* a file for another volume is emptied; ftruncate fills it with zeros */
+  bool reuse = old.magic == CBT_MAGIC && old.num_blocks == num_blocks && st.st_size == (off_t)cbt->size;
+  if ((!reuse && (ftruncate(fd, 0) == -1 || ftruncate(fd, cbt->size) == -1)) ||
+      (cbt->map = mmap(NULL, cbt->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    close(fd);
+    free(cbt);
+    return NULL;
+  }
+  close(fd);
+  cbt->hdr = (cbt_header_t *)cbt->map;
+
+  if (!reuse) {
+    /* nothing is known about earlier writes, so everything counts as changed */
+    cbt->hdr->magic = CBT_MAGIC;
+    cbt->hdr->num_blocks = num_blocks;
+    cbt->hdr->epoch = (old.magic == CBT_MAGIC) ? old.epoch + 1 : 1;
+    cbt->hdr->first_epoch = cbt->hdr->epoch;
+    set_range(bitmap(cbt, cbt->hdr->epoch), 0, num_blocks);
+  } else if (!cbt->hdr->clean) {
+    /* marks made before an unclean shutdown may be missing */
+    set_range(bitmap(cbt, cbt->hdr->epoch), 0, num_blocks);
+  }
+  cbt->hdr->clean = 0;
+  if (cbt_sync(cbt) == -1) {
+    cbt_close(cbt);
+    return NULL;
+  }
+  return cbt;
+}
+
+void cbt_close(cbt_t *cbt)
+{
+  if (!cbt)
+    return;
+  cbt_sync(cbt);
+  munmap(cbt->map, cbt->size);
+  free(cbt);
+}
+
+void cbt_mark(cbt_t *cbt, uint32_t first, uint32_t count)
+{
+  /* the file stops being complete before the first mark that is not on disk */
+  if (cbt->hdr->clean) {
+    cbt->hdr->clean = 0;
+    msync(cbt->map, CBT_HEADER_SIZE, MS_SYNC);
+  }
+  if (first >= cbt->hdr->num_blocks)
+    return;
+  if (count > cbt->hdr->num_blocks - first)
+    count = cbt->hdr->num_blocks - first;
+  set_range(bitmap(cbt, cbt->hdr->epoch), first, count);
+}
+
+int cbt_sync(cbt_t *cbt)
+{
+  if (cbt->hdr->clean)
+    return 0;
+  if (msync(cbt->map, cbt->size, MS_SYNC) == -1)
+    return -1;
+  cbt->hdr->clean = 1;
+  return msync(cbt->map, CBT_HEADER_SIZE, MS_SYNC);
+}
+
+uint32_t cbt_epoch(const cbt_t *cbt)
+{
+  return cbt->hdr->epoch;
+}
+
+int cbt_begin_epoch(cbt_t *cbt, uint32_t *epoch)
+{
+  uint32_t next = cbt->hdr->epoch + 1;
+
+  /* the new epoch reuses the bitmap of the oldest one */
+  if (next - cbt->hdr->first_epoch >= CBT_EPOCHS)
+    cbt->hdr->first_epoch = next - CBT_EPOCHS + 1;
+  memset(bitmap(cbt, next), 0, (size_t)cbt->words * sizeof(uint64_t));
+  cbt->hdr->epoch = next;
+  cbt->hdr->clean = 0;
+  if (cbt_sync(cbt) == -1)
+    return -1;
+  *epoch = next;
+  return 0;
+}
+
+bool cbt_has_epoch(const cbt_t *cbt, uint32_t epoch)
+{
+  return epoch >= cbt->hdr->first_epoch && epoch <= cbt->hdr->epoch;
+}
+
+/* the blocks of word |w| changed in |epoch| or later */
+static uint64_t changed_word(const cbt_t *cbt, uint32_t epoch, uint32_t w)
+{
+  uint64_t bits = 0;
+  for (uint32_t e = epoch; e <= cbt->hdr->epoch; e++)
+    bits |= bitmap(cbt, e)[w];
+  return bits;
+}
+
+int cbt_next_run(const cbt_t *cbt, uint32_t epoch, uint32_t from, uint32_t max_count, uint32_t *first,
+                 uint32_t *count)
+{
+  if (!cbt_has_epoch(cbt, epoch))
+    return -1;
+  uint32_t n = cbt->hdr->num_blocks;
+  if (from >= n || max_count == 0)
+    return 0;
+
+  /* whole words of unchanged blocks are skipped at once */
+  uint32_t w = from / 64;
+  uint64_t bits = changed_word(cbt, epoch, w) & (~(uint64_t)0 << (from % 64));
+  while (!bits) {
+    if (++w >= cbt->words)
+      return 0;
+    bits = changed_word(cbt, epoch, w);
+  }
+  uint32_t b = w * 64 + __builtin_ctzll(bits);
+  if (b >= n)
+    return 0;
+
+  uint32_t c = 1;
+  while (c < max_count && b + c < n) {
+    uint32_t next = b + c;
+    if (!(changed_word(cbt, epoch, next / 64) & ((uint64_t)1 << (next % 64))))
+      break;
+    c++;
+  }
+  *first = b;
+  *count = c;
+  return 1;
+}
@@ -0,0 +1,54 @@
+#ifndef CBT_H_
+#define CBT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Changed-block tracking: which blocks of a volume were written in each
+ * backup epoch, kept in a file so it survives restarts.
+ *
+ * The file holds one bitmap per epoch for the last CBT_EPOCHS epochs. It is
+ * mapped into memory, so marking a block is a bit set. A header flag records
+ * whether the bitmaps on disk are complete; if the process or machine went
+ * down while blocks were being marked, the file is reopened with every block
+ * marked changed in the current epoch, so an incremental backup can never
+ * miss a write. */
+
+/* how many epochs are kept; changes since older epochs need a full backup */
+#define CBT_EPOCHS 8
+
+typedef struct cbt cbt_t;
+
+/* Returns the tracker in the file at |path| for a volume of |num_blocks|
+ * blocks, creating the file if needed, or NULL on failure. A file written for
+ * a different number of blocks starts over at a new epoch with every block
+ * marked changed. */
+cbt_t *cbt_open(const char *path, uint32_t num_blocks);
+
+/* Writes the bitmaps out and closes the tracker. */
+void cbt_close(cbt_t *cbt);
+
+/* Marks |count| blocks starting at block |first| changed in the current epoch. */
+void cbt_mark(cbt_t *cbt, uint32_t first, uint32_t count);
+
+/* Returns 0 on success and -1 on failure. Writes the bitmaps out, after which
+ * the file is complete until the next cbt_mark. */
+int cbt_sync(cbt_t *cbt);
+
+/* The epoch blocks are being marked in now. */
+uint32_t cbt_epoch(const cbt_t *cbt);
+
+/* Returns 0 on success and -1 on failure. Starts a new epoch, stores its
+ * number in |epoch|, and forgets the oldest one if CBT_EPOCHS are kept. */
+int cbt_begin_epoch(cbt_t *cbt, uint32_t *epoch);
+
+/* Whether changes since |epoch| are still known. */
+bool cbt_has_epoch(const cbt_t *cbt, uint32_t epoch);
+
+/* Returns 1 and the next run of blocks changed since |epoch| at or after
+ * block |from| in |first| and |count| (at most |max_count|), 0 when there
+ * are no more, and -1 if |epoch| is not kept. */
+int cbt_next_run(const cbt_t *cbt, uint32_t epoch, uint32_t from, uint32_t max_count, uint32_t *first,
+                 uint32_t *count);
+
+#endif
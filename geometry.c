@@ -0,0 +1,37 @@
+#include "geometry.h"
+
+int jbod_geometry_init(jbod_geometry_t *g, uint32_t num_disks, uint32_t blocks_per_disk)
+{
+  if (num_disks == 0 || blocks_per_disk == 0 ||
+      (uint64_t)num_disks * blocks_per_disk > JBOD_GEOMETRY_MAX_BLOCKS)
+    return -1;
+
+  g->num_disks = num_disks;
+  g->blocks_per_disk = blocks_per_disk;
+  g->pow2 = (blocks_per_disk & (blocks_per_disk - 1)) == 0;
+  g->block_bits = 0;
+  while (g->pow2 && (1u << g->block_bits) < blocks_per_disk)
+    g->block_bits++;
+  g->block_mask = g->pow2 ? blocks_per_disk - 1 : 0;
+  return 1;
+}
+
+static const jbod_geometry_t default_geometry = {
+  .num_disks = JBOD_NUM_DISKS,
+  .blocks_per_disk = JBOD_NUM_BLOCKS_PER_DISK,
+  .pow2 = true,
+  .block_bits = 8,
+  .block_mask = JBOD_NUM_BLOCKS_PER_DISK - 1,
+};
+
+_Static_assert(JBOD_NUM_BLOCKS_PER_DISK == 1 << 8, "default_geometry assumes 256 blocks per disk");
+
+const jbod_geometry_t *jbod_geometry_default(void)
+{
+  return &default_geometry;
+}
+
+bool jbod_geometry_is_default(const jbod_geometry_t *g)
+{
+  return g->num_disks == JBOD_NUM_DISKS && g->blocks_per_disk == JBOD_NUM_BLOCKS_PER_DISK;
+}
@@ -0,0 +1,64 @@
+#ifndef GEOMETRY_H_
+#define GEOMETRY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "jbod.h"
+
+/* The shape of a JBOD array: how many disks, and how many blocks on each.
+ * The jbod.h macros describe the array jbod.o emulates; a v3 server may
+ * report a different one when the volume is mounted (see
+ * JBOD_CMD_GEOMETRY in net.h). Blocks are always JBOD_BLOCK_SIZE bytes, and
+ * a volume addressed by 32-bit byte offsets holds at most
+ * JBOD_GEOMETRY_MAX_BLOCKS of them. */
+
+#define JBOD_GEOMETRY_MAX_BLOCKS ((uint32_t)(((uint64_t)1 << 32) / JBOD_BLOCK_SIZE))
+
+typedef struct {
+  uint32_t num_disks;
+  uint32_t blocks_per_disk;
+  /* set when blocks_per_disk is a power of two, so that splitting a volume
+   * block into disk and block is a shift and a mask rather than a division */
+  bool pow2;
+  int block_bits;
+  uint32_t block_mask;
+} jbod_geometry_t;
+
+/* Returns 1 on success and -1 on failure. Fills in |g| for an array of
+ * |num_disks| disks of |blocks_per_disk| blocks each. */
+int jbod_geometry_init(jbod_geometry_t *g, uint32_t num_disks, uint32_t blocks_per_disk);
+
+/* The array described by jbod.h. */
+const jbod_geometry_t *jbod_geometry_default(void);
+
+bool jbod_geometry_is_default(const jbod_geometry_t *g);
+
+/* Total number of blocks in the array. */
+static inline uint32_t jbod_geometry_blocks(const jbod_geometry_t *g)
+{
+  return g->num_disks * g->blocks_per_disk;
+}
+
+/* Splits |global_block|, counted from the start of the volume, into the
+ * disk holding it and its block on that disk. */
+static inline void jbod_geometry_locate(const jbod_geometry_t *g, uint32_t global_block, int *disk, int *block)
+{
+  if (g->pow2) {
+    *disk = global_block >> g->block_bits;
+    *block = global_block & g->block_mask;
+  } else {
+    *disk = global_block / g->blocks_per_disk;
+    *block = global_block % g->blocks_per_disk;
+  }
+}
+
+/* The inverse of jbod_geometry_locate. */
+static inline uint32_t jbod_geometry_global(const jbod_geometry_t *g, int disk, int block)
+{
+  if (g->pow2)
+    return ((uint32_t)disk << g->block_bits) | (uint32_t)block;
+  return (uint32_t)disk * g->blocks_per_disk + (uint32_t)block;
+}
+
+#endif
@@ -13,22 +13,272 @@
  *                                                                                   
  */
 
+//O_DIRECT, for bulk copies
+#define _GNU_SOURCE
 //This was included to allow the use of boolean variables
 #include <stdbool.h> 
 #include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "mdadm.h"
 #include "util.h"
 #include "jbod.h"
 #include "cache.h"
 #include "net.h"
+#include "geometry.h"
+#include "backend.h"
+#include "cbt.h"
+#include "qos.h"
+#include "trace.h"
 
-//boolean that keeps track of whether or the JBOD has been mounted
-static bool isMounted = false;
+//the most blocks the write-combining buffer can hold
+#define WC_MAX_SLOTS 32
 
+//one block image being assembled by the write-combining buffer
+typedef struct
+{
+  bool used;
+  //block number counted from the start of the volume
+  uint32_t globalBlock;
+  uint8_t data[JBOD_BLOCK_SIZE];
+  //which bytes of data have been written, and how many
+  bool written[JBOD_BLOCK_SIZE];
+  int numWritten;
+} wc_slot_t;
+
+//the most ranges with standing advice a context remembers; the oldest is forgotten to make room
+#define ADVICE_MAX_RANGES 16
+//WILLNEED ranges waiting to be prefetched; advice past this many is dropped
+#define PREFETCH_QUEUE_LEN 16
+//blocks the prefetch thread reads per call, so it lets other calls in between
+#define PREFETCH_RUN_BLOCKS 32
+//how far ahead of a read in a SEQUENTIAL range blocks are kept cached; the read-ahead tops it up in one call
+//once less than half of it is left
+#define READAHEAD_BLOCKS 16
+
+//a range of the volume with standing advice, see mdadm_advise
+typedef struct
+{
+  uint32_t firstBlock;
+  uint32_t numBlocks;
+  mdadm_advice_t advice;
+} advice_range_t;
+
+//a WILLNEED range waiting for the prefetch thread, and the tenant whose advice it was
+typedef struct
+{
+  uint32_t firstBlock;
+  uint32_t numBlocks;
+  int tenant;
+} prefetch_req_t;
+
+//the journal's superblock and the header of each of its records start with this ("JNL1")
+#define JNL_MAGIC 0x4a4e4c31
+//the most blocks one journal record holds: as many as the header block has room to list
+#define JNL_RECORD_BLOCKS ((JBOD_BLOCK_SIZE - 24) / 4)
+//the smallest journal: the superblock and one full record
+#define JNL_MIN_BLOCKS (2 + JNL_RECORD_BLOCKS)
+//the most writes in one group commit, and how long its leader waits at most for the writers queued behind it
+#define JNL_MAX_WAITERS 64
+#define JNL_GROUP_WINDOW_NS 1000000
+//blocks a checkpoint writes home per JBOD call
+#define JNL_CHECKPOINT_RUN_BLOCKS 64
+
+//block 0 of the journal. Only records of its epoch are replayed; each checkpoint starts a new one
+typedef struct
+{
+  uint32_t magic;
+  uint32_t epoch;
+  uint32_t numBlocks;
+  uint32_t unused;
+  //over the fields above
+  uint64_t checksum;
+} jnl_super_t;
+
+//first block of a journal record, which is followed by count blocks of data and says where each of them goes
+typedef struct
+{
+  uint32_t magic;
+  uint32_t epoch;
+  uint32_t count;
+  uint32_t unused;
+  //over this header, with checksum 0, and the data, so a torn record is not replayed
+  uint64_t checksum;
+  uint32_t targets[JNL_RECORD_BLOCKS];
+} jnl_header_t;
+
+_Static_assert(sizeof(jnl_header_t) == JBOD_BLOCK_SIZE, "a journal record header is one block");
+
+//state for one volume: the backend it talks to, its cache, and what the JBOD is pointed at
+struct mdadm_ctx
+{
+  //serializes calls on this context, since a backend takes one operation at a time
+  pthread_mutex_t lock;
+  //decides which tenant's call takes the lock next once tenants are configured, and the ticket of the call holding it
+  qos_t qos;
+  qos_ticket_t ticket;
+  //CLOCK_MONOTONIC deadline of the call holding the lock in nanoseconds, 0 for none
+  int64_t deadline;
+  //backend used for every JBOD operation: the one chosen at mount time, or ownBackend
+  jbod_backend_t *backend;
+  //what a plain mount uses, a connection of the context's own or the default connection
+  jbod_backend_t *ownBackend;
+  bool ownsBackend;
+  //cache used by reads and writes, either a private cache or the default cache
+  cache_t *cache;
+  bool ownsCache;
+  //boolean that keeps track of whether or the JBOD has been mounted
+  bool isMounted;
+  //shape of the array, asked of the server at mount time; all zero before the first mount
+  jbod_geometry_t geometry;
+  //disk and block the JBOD will operate on next, or -1 when unknown
+  int curDisk;
+  int curBlock;
+  //backend generation the seek state belongs to; a reconnect means the server lost it
+  unsigned backendGeneration;
+  //how long a whole mdadm call may take in milliseconds, 0 for no limit
+  int timeoutMs;
+  //write-combining buffer: up to wcMaxSlots blocks held for at most wcWindowMs, 0 slots when off
+  wc_slot_t wcSlots[WC_MAX_SLOTS];
+  int wcMaxSlots;
+  int wcUsed;
+  int wcWindowMs;
+  //when the oldest block in the buffer was first written, and the block written last
+  int64_t wcOpenedNs;
+  wc_slot_t *wcLast;
+  //changed-block tracking file, or NULL when writes are not tracked; the tracker is open while mounted
+  char *cbtPath;
+  cbt_t *cbt;
+  //ranges with standing advice, oldest first; where they overlap the newest wins
+  advice_range_t advice[ADVICE_MAX_RANGES];
+  int numAdvice;
+  //WILLNEED ranges for the prefetch thread, which the first one starts; guarded by prefetchLock, which is
+  //only ever taken after lock, never before
+  pthread_mutex_t prefetchLock;
+  pthread_cond_t prefetchCond;
+  prefetch_req_t prefetchQueue[PREFETCH_QUEUE_LEN];
+  int prefetchHead;
+  int prefetchLen;
+  pthread_t prefetchThread;
+  bool prefetchStarted;
+  bool prefetchStop;
+  //size of the write-ahead journal the next mount sets up in the last blocks of the volume, 0 for none
+  int jnlConfigured;
+  //the journal of this mount: jnlBlocks blocks from jnlStart, the end of what callers see of the volume. The next
+  //record goes jnlHead blocks in, with epoch jnlEpoch
+  bool jnlActive;
+  uint32_t jnlBlocks;
+  uint32_t jnlStart;
+  uint32_t jnlHead;
+  uint32_t jnlEpoch;
+  //the newest image of every block journaled since the last checkpoint, found by block number through an
+  //open-addressing index; jnlOrder is room for sorting them
+  uint32_t *jnlDirtyBlocks;
+  uint8_t *jnlDirtyData;
+  int32_t *jnlDirtyIndex;
+  uint32_t jnlIndexMask;
+  uint32_t jnlDirtyCount;
+  uint64_t *jnlOrder;
+  //the group commit being gathered: its blocks, where each write in it wants its result, and whether a leader is
+  //waiting to journal it. jnlCond is signalled whenever the batch grows or goes out
+  uint32_t jnlBatchBlocks[JNL_RECORD_BLOCKS];
+  uint8_t jnlBatchData[JNL_RECORD_BLOCKS * JBOD_BLOCK_SIZE];
+  int jnlBatchCount;
+  int *jnlWaiters[JNL_MAX_WAITERS];
+  int jnlNumWaiters;
+  bool jnlLeader;
+  pthread_cond_t jnlCond;
+  //writers that have called in but not yet got the lock, which the leader of a group commit waits for
+  atomic_int writersWaiting;
+};
+
+//the most blocks a single read or write can touch: 1024 bytes that do not start on a block boundary
+#define MAX_IO_BLOCKS (1024 / JBOD_BLOCK_SIZE + 1)
+
+//the most changed blocks handed to an export callback at once
+#define EXPORT_RUN_BLOCKS 64
+
+//blocks per buffer in bulk copies, one JBOD call each; a power of two keeps file offsets aligned for O_DIRECT
+#define BULK_RUN_BLOCKS 128
+//buffers in flight between the stages of a bulk copy, and the alignment O_DIRECT wants of them
+#define BULK_BUFFERS 4
+#define BULK_ALIGN 4096
+//volume or file, checksum, file or volume
+#define BULK_MAX_STAGES 3
+
+//64-bit FNV-1a, the checksum of bulk copies and journal records
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static int readBlocks(mdadm_ctx_t *ctx, uint32_t firstBlock, int count, uint8_t *buffer);
+
+//helper method that tells whether the backend's blocks can be read in place, which leaves nothing for the cache to save.
+//a journaled block may be newer in the journal than in place, so with a journal every read goes through fetchRun
+static bool mapped(mdadm_ctx_t *ctx)
+{
+  return ctx->backend->ops->block_ptr != NULL && !ctx->jnlActive;
+}
+
+//helper method that gives the number of blocks callers see, which stops short of the journal
+static uint32_t volumeBlocks(mdadm_ctx_t *ctx)
+{
+  return ctx->jnlActive ? ctx->jnlStart : jbod_geometry_blocks(&ctx->geometry);
+}
+
+//helper method that hashes len bytes of data into hash with FNV-1a
+static uint64_t fnv1a(uint64_t hash, const uint8_t *data, size_t len)
+{
+  for (size_t i = 0; i < len; i++)
+  {
+    hash = (hash ^ data[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+static int writeBlocks(mdadm_ctx_t *ctx, uint32_t firstBlock, int count, const uint8_t *buffer);
+static int exportBlocks(mdadm_ctx_t *ctx, uint32_t firstBlock, int count, uint8_t *buffer);
+
+//helper method that finds the standing advice for globalBlock: the newest range holding it, or NORMAL
+static mdadm_advice_t adviceFor(mdadm_ctx_t *ctx, uint32_t globalBlock)
+{
+  for (int i = ctx->numAdvice - 1; i >= 0; i--)
+  {
+    if (globalBlock - ctx->advice[i].firstBlock < ctx->advice[i].numBlocks)
+    {
+      return ctx->advice[i].advice;
+    }
+  }
+  return MDADM_ADVICE_NORMAL;
+}
+
+//tenant the calling thread's requests are scheduled as, see mdadm_set_tenant
+static __thread int currentTenant = 0;
+
+//context behind mdadm_mount/mdadm_unmount/mdadm_read/mdadm_write
+static mdadm_ctx_t defaultCtx = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .qos = QOS_INITIALIZER,
+  .prefetchLock = PTHREAD_MUTEX_INITIALIZER,
+  .prefetchCond = PTHREAD_COND_INITIALIZER,
+  .jnlCond = PTHREAD_COND_INITIALIZER,
+  .backend = NULL,
+  .cache = NULL,
+  .isMounted = false,
+  .curDisk = -1,
+  .curBlock = -1,
+};
 
-//helper method that takes in diskID, blockID, and command and puts it into one unsigned int
+
+//helper method that takes in diskID, blockID, and command and puts it into one unsigned int.
+//the fields only reach the disks and blocks in jbod.h; larger arrays are addressed through the wide extent commands
 uint32_t encode(int diskID, int blockID, int command, int reserved)
 {
   uint32_t retval = 0x0, tempa, tempb, tempc, tempd;
@@ -43,447 +293,2676 @@ uint32_t encode(int diskID, int blockID, int command, int reserved)
 
 
 
-int mdadm_mount(void) 
+//helper method that moves the JBOD to diskID/blockID, skipping seeks the JBOD is already at
+static int seekTo(mdadm_ctx_t *ctx, int diskID, int blockID)
 {
-  //if it is unmounted, mounts it and returns 1
-  if (!isMounted)
+  //a reconnected server starts a new client wherever the JBOD happens to be
+  unsigned generation = ctx->backend->ops->generation(ctx->backend);
+  if (ctx->backendGeneration != generation)
   {
-    isMounted = true;
-    //calls encode helper method to make create op variable
-    uint32_t op = encode(0, 0, JBOD_MOUNT, 0);
-    jbod_client_operation(op, NULL);
-    return 1;
+    ctx->backendGeneration = generation;
+    ctx->curDisk = -1;
+  }
+  if (ctx->curDisk != diskID)
+  {
+    //seeking to a disk also moves the JBOD to block 0 of that disk
+    if (ctx->backend->ops->operation(ctx->backend, encode(diskID, 0, JBOD_SEEK_TO_DISK, 0), NULL) == -1)
+    {
+      ctx->curDisk = -1;
+      return -1;
+    }
+    ctx->curDisk = diskID;
+    ctx->curBlock = 0;
+  }
+  if (ctx->curBlock != blockID)
+  {
+    if (ctx->backend->ops->operation(ctx->backend, encode(0, blockID, JBOD_SEEK_TO_BLOCK, 0), NULL) == -1)
+    {
+      ctx->curDisk = -1;
+      return -1;
+    }
+    ctx->curBlock = blockID;
   }
-  return -1;
+  return 1;
 }
 
 
 
-int mdadm_unmount(void) 
+//helper method that records the JBOD moving past a block after it was read or written
+static void advance(mdadm_ctx_t *ctx)
 {
-  //if it is mounted, unmounts it and returns 1
-  if (isMounted)
+  ctx->curBlock++;
+  //the JBOD does not wrap onto the next disk, so the next access has to seek
+  if (ctx->curBlock >= (int)ctx->geometry.blocks_per_disk)
   {
-    isMounted = false;
-    //calls encode helper method to make create op variable
-    uint32_t op = encode(0, 0, JBOD_UNMOUNT, 0);
-    jbod_client_operation(op, NULL);
-    return 1;
+    ctx->curDisk = -1;
   }
-  return -1;
 }
 
 
 
-//helper method that checks the input of mdadm_read and determines if it is valid or not
-bool inputCheck(uint32_t addr, uint32_t len, bool isNull)
+//helper method that does the work of fetchRun
+static int fetchFromBackend(mdadm_ctx_t *ctx, int diskID, int blockID, int count, uint8_t *buffer)
 {
-  bool invalidInput = false;
-  //checks to see if the address is out of bounds or if the input is otherwise invalid
-  if ((addr + len) > (JBOD_DISK_SIZE * JBOD_NUM_DISKS) || addr < 0 || len > 1024 || len < 0)
+  //a backend with extents, e.g. a v2 server, reads the whole run, seeks included, in one call
+  if (ctx->backend->ops->has_extents(ctx->backend))
   {
-    invalidInput = true;
+    if (ctx->backend->ops->read_extent(ctx->backend, diskID, blockID, count, buffer) == -1)
+    {
+      ctx->curDisk = -1;
+      return -1;
+    }
+    ctx->curDisk = diskID;
+    ctx->curBlock = blockID + count - 1;
+    advance(ctx);
+    return 1;
   }
-  //if read is passed a NULL pointer and non-zero length, it is invalid
-  if (isNull && len != 0)
+  //otherwise seeks once and reads block by block, since each read moves the JBOD to the next block
+  for (int i = 0; i < count; i++)
   {
-    invalidInput = true;
+    if (seekTo(ctx, diskID, blockID + i) == -1)
+    {
+      return -1;
+    }
+    if (ctx->backend->ops->operation(ctx->backend, encode(0, 0, JBOD_READ_BLOCK, 0), buffer + i * JBOD_BLOCK_SIZE) == -1)
+    {
+      ctx->curDisk = -1;
+      return -1;
+    }
+    advance(ctx);
   }
-  return invalidInput;
+  return 1;
 }
 
 
 
-int mdadm_read(uint32_t addr, uint32_t len, uint8_t *buf) 
+//helper method that does the work of storeRun
+static int storeToBackend(mdadm_ctx_t *ctx, int diskID, int blockID, int count, const uint8_t *buffer)
 {
-  //boolean that holds whether the buffer is null
-  bool isNull = (buf == NULL);
-  //calls helper method to determine if the input is invalid
-  bool invalidInput = inputCheck(addr, len, isNull);
-
-  //returns -1 if the input is invalid or if read is called when it is unmounted 
-  if (invalidInput || !isMounted)
+  //a backend with extents, e.g. a v2 server, writes the whole run, seeks included, in one call
+  if (ctx->backend->ops->has_extents(ctx->backend))
   {
-    return -1;
+    if (ctx->backend->ops->write_extent(ctx->backend, diskID, blockID, count, buffer) == -1)
+    {
+      ctx->curDisk = -1;
+      return -1;
+    }
+    ctx->curDisk = diskID;
+    ctx->curBlock = blockID + count - 1;
+    advance(ctx);
+    return 1;
   }
-  
-  //caluclates disk and block id
-  int diskID = addr / JBOD_DISK_SIZE;
-  int blockID = (addr - (diskID * JBOD_DISK_SIZE))/JBOD_BLOCK_SIZE;
-
-  //calls seek operations to move the IO values to the correct starting position
-  int32_t op = encode(diskID, 0, JBOD_SEEK_TO_DISK, 0);
-  int seekDiskCheck = jbod_client_operation(op, NULL);
-  op = encode(0, blockID, JBOD_SEEK_TO_BLOCK, 0);
-  int seekBlockCheck = jbod_client_operation(op, NULL);
-  op = encode(0, 0, JBOD_READ_BLOCK, 0);
-  int readBlockCheck = 0;
-  int readCacheCheck = 0;
-  //creates a buffer the size of a block
-  uint8_t buffer[JBOD_BLOCK_SIZE];
-  
-  
-  if(cache_enabled())
+  for (int i = 0; i < count; i++)
   {
-    //calls cache lookup to see if the current block is in the cache
-    readCacheCheck = cache_lookup(diskID, blockID, buffer);
-    //if it is not in the cache, calls the JBOD operation to read from the database into the buffer and then writes the block to the cache
-    if (readCacheCheck == -1)
+    if (seekTo(ctx, diskID, blockID + i) == -1)
     {
-      //calls read block operation to read data from current disk and block into buffer
-      readBlockCheck = jbod_client_operation(op, buffer);
-      cache_insert(diskID, blockID, buffer);
+      return -1;
     }
-    else
+    //the JBOD does not modify the block on a write, the copy only drops the const
+    uint8_t tempBuffer[JBOD_BLOCK_SIZE];
+    memcpy(tempBuffer, buffer + i * JBOD_BLOCK_SIZE, JBOD_BLOCK_SIZE);
+    if (ctx->backend->ops->operation(ctx->backend, encode(0, 0, JBOD_WRITE_BLOCK, 0), tempBuffer) == -1)
     {
-      //if cache_lookup is successful, seek to blockID + 1
-      op = encode(0, blockID + 1, JBOD_SEEK_TO_BLOCK, 0);
-      seekBlockCheck = jbod_client_operation(op, NULL);
+      ctx->curDisk = -1;
+      return -1;
     }
+    advance(ctx);
   }
-  else
-  {
-    //calls read block operation to read data from current disk and block into buffer
-    readBlockCheck = jbod_client_operation(op, buffer);
-  }
-  
+  return 1;
+}
+
+
 
-  //returns -1 if any of the checks failed
-  if (seekDiskCheck == -1 || seekBlockCheck == -1 || readBlockCheck == -1)
+//helper method that opens a trace span for a run of count blocks starting at diskID/blockID
+static void traceRun(const char *name, int diskID, int blockID, int count)
+{
+  trace_begin(name);
+  trace_arg("disk", diskID);
+  trace_arg("block", blockID);
+  trace_arg("count", count);
+}
+
+
+
+//helper method that finds the journaled image of globalBlock, or NULL if it has not been journaled since the last
+//checkpoint
+static uint8_t *jnlDirtyFind(mdadm_ctx_t *ctx, uint32_t globalBlock)
+{
+  //the index is kept at most half full, so the probe always reaches an empty slot
+  for (uint32_t h = (globalBlock * 2654435761u) & ctx->jnlIndexMask; ctx->jnlDirtyIndex[h] != -1;
+       h = (h + 1) & ctx->jnlIndexMask)
   {
-    return -1;
+    if (ctx->jnlDirtyBlocks[ctx->jnlDirtyIndex[h]] == globalBlock)
+    {
+      return ctx->jnlDirtyData + (size_t)ctx->jnlDirtyIndex[h] * JBOD_BLOCK_SIZE;
+    }
   }
-  
-  //keeps track of how many bits have been read
-  uint32_t remainingReadLen = len;
+  return NULL;
+}
 
-  //finds the starting address of the current block and disk
-  int startAddrOfBlock = ((diskID) * JBOD_NUM_BLOCKS_PER_DISK * JBOD_BLOCK_SIZE) + ((blockID)*(JBOD_BLOCK_SIZE));
-  //finds the index of addr within the current block
-  int currentAddr = addr - startAddrOfBlock;
-  
-  //value that keeps track of how many numbers have been read into buf
-  int numRead = 0;
 
 
-  //loops until all required values have been read
-  while (remainingReadLen > 0)
+//helper method that records data as the newest image of globalBlock once it is journaled
+static void jnlDirtyPut(mdadm_ctx_t *ctx, uint32_t globalBlock, const uint8_t *data)
+{
+  uint32_t h = (globalBlock * 2654435761u) & ctx->jnlIndexMask;
+  while (ctx->jnlDirtyIndex[h] != -1 && ctx->jnlDirtyBlocks[ctx->jnlDirtyIndex[h]] != globalBlock)
   {
-    //variable that calculates the last index of the current disk
-    int endOfDisk = ((diskID + 1)*(JBOD_BLOCK_SIZE * JBOD_NUM_BLOCKS_PER_DISK)) - 1;
+    h = (h + 1) & ctx->jnlIndexMask;
+  }
+  if (ctx->jnlDirtyIndex[h] == -1)
+  {
+    ctx->jnlDirtyIndex[h] = ctx->jnlDirtyCount;
+    ctx->jnlDirtyBlocks[ctx->jnlDirtyCount++] = globalBlock;
+  }
+  memcpy(ctx->jnlDirtyData + (size_t)ctx->jnlDirtyIndex[h] * JBOD_BLOCK_SIZE, data, JBOD_BLOCK_SIZE);
+}
 
-    //if the read would extend beyond the current disk/block and the current block is the last on the disk
-    if (((addr + numRead + remainingReadLen) > endOfDisk) && (currentAddr + remainingReadLen > JBOD_BLOCK_SIZE) && (blockID == JBOD_NUM_BLOCKS_PER_DISK - 1))
-    {
-      //copies the information in the buffer into the buf array
-      memcpy(&buf[numRead], buffer + currentAddr, JBOD_BLOCK_SIZE - currentAddr);
-      //subtracts the amount that was read from the remainingReadLen and adds it to numRead
-      remainingReadLen -= (JBOD_BLOCK_SIZE - currentAddr);
-      numRead += (JBOD_BLOCK_SIZE - currentAddr);
-      //sets the currentAddr to 0 since the next read will start at the start of a block
-      currentAddr = 0;
 
-      //Moves to the next disk
-      diskID++;
-      blockID = 0;
-      //calls seek operations to move the IO value to the correct starting position
-      op = encode(diskID, 0, JBOD_SEEK_TO_DISK, 0);
-      seekDiskCheck = jbod_client_operation(op, NULL);
 
-      //primes the op for use in the read block method
-      op = encode(0, 0, JBOD_READ_BLOCK, 0);
+//helper method that forgets every journaled image, once they are all home
+static void jnlDirtyClear(mdadm_ctx_t *ctx)
+{
+  memset(ctx->jnlDirtyIndex, 0xff, (size_t)(ctx->jnlIndexMask + 1) * sizeof(int32_t));
+  ctx->jnlDirtyCount = 0;
+}
 
 
-      if(cache_enabled())
-      {
-        //calls cache lookup to see if the current block is in the cache
-        readCacheCheck = cache_lookup(diskID, blockID, buffer);
-        //if it is not in the cache, calls the JBOD operation to read from the database into the buffer and then writes the block to the cache
-        if (readCacheCheck == -1)
-        {
-          //calls read block operation to read data from current disk and block into buffer
-          readBlockCheck = jbod_client_operation(op, buffer);
-          cache_insert(diskID, blockID, buffer);
-        }
-        else
-        {
-          //if cache_lookup is successful, seek to blockID + 1
-          op = encode(0, blockID + 1, JBOD_SEEK_TO_BLOCK, 0);
-          seekBlockCheck = jbod_client_operation(op, NULL);
-        }
-      }
-      else
+
+//helper method that reads count consecutive blocks of one disk from the JBOD into buffer, bypassing the cache
+static int fetchRun(mdadm_ctx_t *ctx, int diskID, int blockID, int count, uint8_t *buffer)
+{
+  traceRun("fetch_run", diskID, blockID, count);
+  int rc = fetchFromBackend(ctx, diskID, blockID, count, buffer);
+  //blocks journaled since the last checkpoint are newer than what is in place
+  if (rc == 1 && ctx->jnlDirtyCount > 0)
+  {
+    for (int i = 0; i < count; i++)
+    {
+      const uint8_t *data = jnlDirtyFind(ctx, jbod_geometry_global(&ctx->geometry, diskID, blockID + i));
+      if (data != NULL)
       {
-        //calls read block operation to read data from current disk and block into buffer
-        readBlockCheck = jbod_client_operation(op, buffer);
+        memcpy(buffer + i * JBOD_BLOCK_SIZE, data, JBOD_BLOCK_SIZE);
       }
+    }
+  }
+  trace_end();
+  return rc;
+}
 
 
-      //returns -1 if the block reading/disk movement fails
-      if (seekDiskCheck == -1 || readBlockCheck == -1)
+
+//helper method that writes count consecutive blocks of one disk from buffer to the JBOD
+static int storeRun(mdadm_ctx_t *ctx, int diskID, int blockID, int count, const uint8_t *buffer)
+{
+  traceRun("store_run", diskID, blockID, count);
+  int rc = storeToBackend(ctx, diskID, blockID, count, buffer);
+  trace_end();
+  return rc;
+}
+
+
+
+//helper method that reads count whole blocks, starting at the firstBlock'th block of the volume, into buffer.
+//blocks found in the cache are copied from it, the rest are fetched in runs and then written to the cache
+static int readBlocks(mdadm_ctx_t *ctx, uint32_t firstBlock, int count, uint8_t *buffer)
+{
+  //blocks the backend maps into memory are copied straight out of the mapping
+  if (mapped(ctx))
+  {
+    for (int i = 0; i < count; i++)
+    {
+      int diskID, blockID;
+      jbod_geometry_locate(&ctx->geometry, firstBlock + i, &diskID, &blockID);
+      const uint8_t *src = ctx->backend->ops->block_ptr(ctx->backend, diskID, blockID);
+      if (src == NULL)
       {
         return -1;
       }
+      memcpy(buffer + i * JBOD_BLOCK_SIZE, src, JBOD_BLOCK_SIZE);
     }
+    return 1;
+  }
 
+  bool useCache = cache_ctx_enabled(ctx->cache);
+  int i = 0;
+  while (i < count)
+  {
+    int diskID, blockID;
+    jbod_geometry_locate(&ctx->geometry, firstBlock + i, &diskID, &blockID);
+    uint8_t *dst = buffer + i * JBOD_BLOCK_SIZE;
 
-    //if the read would extend beyond the current block
-    else if((currentAddr + remainingReadLen) > JBOD_BLOCK_SIZE)
+    //calls cache lookup to see if the current block is in the cache
+    if (useCache && cache_ctx_lookup(ctx->cache, diskID, blockID, dst) == 1)
     {
-      //copies the information in the buffer into the buf array
-      memcpy(&buf[numRead], buffer + currentAddr, JBOD_BLOCK_SIZE - currentAddr);
-      //subtracts the amount that was read from the remainingReadLen and adds it to numRead
-      remainingReadLen -= (JBOD_BLOCK_SIZE - currentAddr);
-      numRead += (JBOD_BLOCK_SIZE - currentAddr);
-      //sets the currentAddr to 0 since the next read will start at the start of a block
-      currentAddr = 0;
-      //primes the op for use in the read block method
-      op = encode(0, 0, JBOD_READ_BLOCK, 0);
+      i++;
+      continue;
+    }
 
+    //extends the run of missing blocks until a cached block, the end of the disk or the end of the request
+    int run = 1;
+    bool nextCached = false;
+    while (i + run < count && blockID + run < (int)ctx->geometry.blocks_per_disk && run < JBOD_MAX_EXTENT_BLOCKS)
+    {
+      if (useCache && cache_ctx_lookup(ctx->cache, diskID, blockID + run, dst + run * JBOD_BLOCK_SIZE) == 1)
+      {
+        nextCached = true;
+        break;
+      }
+      run++;
+    }
 
-      if(cache_enabled())
+    if (fetchRun(ctx, diskID, blockID, run, dst) == -1)
+    {
+      return -1;
+    }
+    //blocks under NOREUSE advice are not kept
+    if (useCache)
+    {
+      for (int j = 0; j < run; j++)
       {
-        //calls cache lookup to see if the current block is in the cache
-        readCacheCheck = cache_lookup(diskID, blockID, buffer);
-        //if it is not in the cache, calls the JBOD operation to read from the database into the buffer and then writes the block to the cache
-        if (readCacheCheck == -1)
-        {
-          //calls read block operation to read data from current disk and block into buffer
-          readBlockCheck = jbod_client_operation(op, buffer);
-          cache_insert(diskID, blockID, buffer);
-        }
-        else
+        if (adviceFor(ctx, firstBlock + i + j) != MDADM_ADVICE_NOREUSE)
         {
-          //if cache_lookup is successful, seek to blockID + 1
-          op = encode(0, blockID + 1, JBOD_SEEK_TO_BLOCK, 0);
-          seekBlockCheck = jbod_client_operation(op, NULL);
+          cache_ctx_insert(ctx->cache, diskID, blockID + j, dst + j * JBOD_BLOCK_SIZE);
         }
       }
-      else
-      {
-        //calls read block operation to read data from current disk and block into buffer
-        readBlockCheck = jbod_client_operation(op, buffer);
-      }
+    }
+    //the cached block that ended the run has already been copied
+    i += run + (nextCached ? 1 : 0);
+  }
+  return 1;
+}
 
 
-      //returns -1 if the block reading fails
-      if (readBlockCheck == -1)
-      {
-        return -1;
-      }
-      blockID++;
-    }
 
+//helper method that writes count whole blocks from buffer, starting at the firstBlock'th block of the volume,
+//to the JBOD in runs that stop at the end of a disk, leaving the cache alone
+static int storeBlocks(mdadm_ctx_t *ctx, uint32_t firstBlock, int count, const uint8_t *buffer)
+{
+  int i = 0;
+  while (i < count)
+  {
+    int diskID, blockID;
+    jbod_geometry_locate(&ctx->geometry, firstBlock + i, &diskID, &blockID);
+
+    //writes up to the end of the disk or the end of the request in one run
+    int run = count - i;
+    if (run > (int)ctx->geometry.blocks_per_disk - blockID)
+    {
+      run = ctx->geometry.blocks_per_disk - blockID;
+    }
+    if (run > JBOD_MAX_EXTENT_BLOCKS)
+    {
+      run = JBOD_MAX_EXTENT_BLOCKS;
+    }
 
-    //if the read stays within the current block
-    else if((currentAddr + remainingReadLen) <= JBOD_BLOCK_SIZE)
+    if (storeRun(ctx, diskID, blockID, run, buffer + i * JBOD_BLOCK_SIZE) == -1)
     {
-      //read however much is left on remainingReadLen into buf, and set the remaining read length to zero
-      memcpy(&buf[numRead], buffer + currentAddr, remainingReadLen);
-      remainingReadLen = 0;
+      return -1;
     }
+    i += run;
   }
-  return len;
+  return 1;
 }
 
 
-int mdadm_write(uint32_t addr, uint32_t len, const uint8_t *buf) 
-{
-  //boolean that holds whether the buffer is null
-  bool isNull = (buf == NULL);
-  //calls helper method to determine if the input is invalid
-  bool invalidInput = inputCheck(addr, len, isNull);
 
-  //returns -1 if the input is invalid or if read is called when it is unmounted 
-  if (invalidInput || !isMounted)
+//helper method that brings the cache in line with count blocks from firstBlock having been written from buffer.
+//cache_insert updates the entry if the block is already in the cache; a shared cache drops it instead,
+//since another process may be about to fill it with what it read before this write
+static void keepWritten(mdadm_ctx_t *ctx, uint32_t firstBlock, int count, const uint8_t *buffer)
+{
+  if (!cache_ctx_enabled(ctx->cache) || mapped(ctx))
   {
-    return -1;
+    return;
   }
-  
-  //caluclates disk and block id
-  int diskID = addr / JBOD_DISK_SIZE;
-  int blockID = (addr - (diskID * JBOD_DISK_SIZE))/JBOD_BLOCK_SIZE;
+  for (int i = 0; i < count; i++)
+  {
+    int diskID, blockID;
+    jbod_geometry_locate(&ctx->geometry, firstBlock + i, &diskID, &blockID);
+    if (cache_ctx_is_shared(ctx->cache))
+    {
+      cache_ctx_invalidate(ctx->cache, diskID, blockID);
+    }
+    else if (adviceFor(ctx, firstBlock + i) == MDADM_ADVICE_NOREUSE)
+    {
+      //under NOREUSE a block is only kept up to date if it is already cached
+      cache_ctx_update(ctx->cache, diskID, blockID, buffer + i * JBOD_BLOCK_SIZE);
+    }
+    else
+    {
+      cache_ctx_insert(ctx->cache, diskID, blockID, buffer + i * JBOD_BLOCK_SIZE);
+    }
+  }
+}
 
-  //calls seek operations to move the IO values to the correct starting position
-  int32_t op = encode(diskID, 0, JBOD_SEEK_TO_DISK, 0);
-  int seekDiskCheck = jbod_client_operation(op, NULL);
-  op = encode(0, blockID, JBOD_SEEK_TO_BLOCK, 0);
-  int seekBlockCheck = jbod_client_operation(op, NULL);
-  op = encode(0, 0, JBOD_WRITE_BLOCK, 0);
-  //finds the starting address of the current block and disk
-  int startAddrOfBlock = ((diskID) * JBOD_NUM_BLOCKS_PER_DISK * JBOD_BLOCK_SIZE) + ((blockID)*(JBOD_BLOCK_SIZE));
-  //finds the index of addr within the current block
-  int currentAddr = addr - startAddrOfBlock;
 
-  //creates buffer the size of a block
-  uint8_t buffer[JBOD_BLOCK_SIZE];
 
-  //calls mdadm_read to read a copy of the block
-  int readBlockCheck = mdadm_read(startAddrOfBlock, JBOD_BLOCK_SIZE, buffer);
+//helper method that writes count whole blocks from buffer, starting at the firstBlock'th block of the volume,
+//and keeps the cache in sync
+static int writeBlocks(mdadm_ctx_t *ctx, uint32_t firstBlock, int count, const uint8_t *buffer)
+{
+  if (storeBlocks(ctx, firstBlock, count, buffer) == -1)
+  {
+    //part of the write may have reached the JBOD, so the cached copies can no longer be trusted
+    if (cache_ctx_enabled(ctx->cache) && !mapped(ctx))
+    {
+      for (int i = 0; i < count; i++)
+      {
+        int diskID, blockID;
+        jbod_geometry_locate(&ctx->geometry, firstBlock + i, &diskID, &blockID);
+        cache_ctx_invalidate(ctx->cache, diskID, blockID);
+      }
+    }
+    return -1;
+  }
+  keepWritten(ctx, firstBlock, count, buffer);
+  return 1;
+}
 
 
-  //value that keeps track of how many numbers have been read from buf
-  int numRead = 0;
-  //keeps track of how many bits have been read
-  uint32_t remainingReadLen = len;
 
-  //check used to see if the write block method failed
-  int writeBlockCheck = 0;
-  //returns -1 if any of the checks failed
-  if (seekDiskCheck == -1 || seekBlockCheck == -1 || readBlockCheck == -1)
+//helper method that writes the journal's superblock for the current epoch and makes it durable
+static int jnlWriteSuper(mdadm_ctx_t *ctx)
+{
+  jnl_super_t super = { .magic = JNL_MAGIC, .epoch = ctx->jnlEpoch, .numBlocks = ctx->jnlBlocks };
+  super.checksum = fnv1a(FNV_OFFSET_BASIS, (const uint8_t *)&super, offsetof(jnl_super_t, checksum));
+  uint8_t block[JBOD_BLOCK_SIZE] = { 0 };
+  memcpy(block, &super, sizeof(super));
+  if (storeBlocks(ctx, ctx->jnlStart, 1, block) == -1 || ctx->backend->ops->flush(ctx->backend) == -1)
   {
     return -1;
   }
+  return 1;
+}
 
 
-  //loops until all values from buf have been read/written into the JBOD
-  while (remainingReadLen > 0)
-  {
-    startAddrOfBlock = ((diskID) * JBOD_NUM_BLOCKS_PER_DISK * JBOD_BLOCK_SIZE) + ((blockID)*(JBOD_BLOCK_SIZE));
 
-    //calls the seek to block method again becuase reading the block causes the IO value to shift
-    op = encode(0, blockID, JBOD_SEEK_TO_BLOCK, 0);
-    seekBlockCheck = jbod_client_operation(op, NULL);
-    op = encode(0, 0, JBOD_WRITE_BLOCK, 0);
+//helper method used by qsort to put journaled blocks, block number above index, in volume order
+static int jnlCompare(const void *a, const void *b)
+{
+  uint64_t keyA = *(const uint64_t *)a, keyB = *(const uint64_t *)b;
+  return (keyA > keyB) - (keyA < keyB);
+}
 
-    if (seekBlockCheck == -1)
-    {
-      return -1;
-    }
- 
-    int readCacheCheck = 0;
-    //creates a buffer the size of a block that is used when checking if a block is in the cache
-    uint8_t tempBuffer[JBOD_BLOCK_SIZE];
 
-    //if the write would extend beyond the current block and the current block is the last on the disk
-    if ((currentAddr + remainingReadLen > JBOD_BLOCK_SIZE) && (blockID == JBOD_NUM_BLOCKS_PER_DISK - 1))
-    {
 
-      //replace however many numbers are needed in the current block into buffer
-      memcpy(&buffer[currentAddr], &buf[numRead], JBOD_BLOCK_SIZE - currentAddr);
-      //subtracts the amount that was read from the remainingReadLen and adds it to numRead
-      remainingReadLen -= (JBOD_BLOCK_SIZE - currentAddr);
-      numRead += (JBOD_BLOCK_SIZE - currentAddr);
-      //sets the currentAddr to 0 since the next read will start at the start of a block
-      currentAddr = 0;
-      
-      //primes the op for use in the write block method
-      op = encode(0, 0, JBOD_WRITE_BLOCK, 0);
+//helper method that writes every block journaled since the last checkpoint to its place in the volume, in disk/block
+//order so neighbours share one run, then starts a new epoch, which retires the records. If it fails the journal is
+//left looking full, so the next record tries again first; until then the records can still be replayed
+static int jnlCheckpoint(mdadm_ctx_t *ctx)
+{
+  if (ctx->jnlHead == 1)
+  {
+    return 1;
+  }
+  trace_begin("jnl_checkpoint");
+  trace_arg("blocks", ctx->jnlDirtyCount);
+  for (uint32_t i = 0; i < ctx->jnlDirtyCount; i++)
+  {
+    ctx->jnlOrder[i] = ((uint64_t)ctx->jnlDirtyBlocks[i] << 32) | i;
+  }
+  qsort(ctx->jnlOrder, ctx->jnlDirtyCount, sizeof(uint64_t), jnlCompare);
 
-    
-      if(cache_enabled())
-      {
-        //calls cache_lookup to check if the block is already in the cache
-        readCacheCheck = cache_lookup(diskID, blockID, tempBuffer);
-        //if the block is currently not in the cache, writes it to the cache
-        if (readCacheCheck == -1)
-        {
-          cache_insert(diskID, blockID, buffer);
-        }
-        //if the block is currently in the cache, updates it instead
-        else
-        {
-          cache_update(diskID, blockID, buffer);
-        }
-      }
-      //calls write block method to write the data into the JBOD
-      writeBlockCheck = jbod_client_operation(op, buffer);
-
-      //sets the disk and block ID's for the next read
-      diskID++;
-      blockID = 0;
-      //calls seek operations to move the IO value to the correct starting position
-      op = encode(diskID, 0, JBOD_SEEK_TO_DISK, 0);
-      seekDiskCheck = jbod_client_operation(op, NULL);
-      //calls mdadm_read to read a copy of the next block into buffer
-      int readBlockCheck = mdadm_read(startAddrOfBlock + JBOD_BLOCK_SIZE, JBOD_BLOCK_SIZE, buffer);
-      //returns -1 if the block reading/writing or disk movement fails
-      if (seekDiskCheck == -1 || writeBlockCheck == -1 || readBlockCheck == -1)
-      {
-        return -1;
-      }
+  uint8_t run[JNL_CHECKPOINT_RUN_BLOCKS * JBOD_BLOCK_SIZE];
+  int rc = 1;
+  uint32_t i = 0;
+  while (rc == 1 && i < ctx->jnlDirtyCount)
+  {
+    uint32_t first = ctx->jnlOrder[i] >> 32;
+    int count = 0;
+    while (i + count < ctx->jnlDirtyCount && count < JNL_CHECKPOINT_RUN_BLOCKS &&
+           (ctx->jnlOrder[i + count] >> 32) == first + count)
+    {
+      memcpy(run + count * JBOD_BLOCK_SIZE, ctx->jnlDirtyData + (ctx->jnlOrder[i + count] & 0xffffffff) * JBOD_BLOCK_SIZE,
+             JBOD_BLOCK_SIZE);
+      count++;
     }
-    
+    rc = storeBlocks(ctx, first, count, run);
+    i += count;
+  }
+  //the blocks have to be durable in place before the superblock stops their records from being replayed
+  if (rc == 1 && ctx->backend->ops->flush(ctx->backend) == -1)
+  {
+    rc = -1;
+  }
+  if (rc == 1)
+  {
+    ctx->jnlEpoch++;
+    rc = jnlWriteSuper(ctx);
+  }
+  if (rc == 1)
+  {
+    jnlDirtyClear(ctx);
+    ctx->jnlHead = 1;
+  }
+  else
+  {
+    ctx->jnlHead = ctx->jnlBlocks;
+  }
+  trace_end();
+  return rc;
+}
 
-    //if the write would extend beyond the current block
-    else if((currentAddr + remainingReadLen) > JBOD_BLOCK_SIZE)
-    {
-      //replace however many numbers are needed in the current block into buffer
-      memcpy(&buffer[currentAddr], &buf[numRead], JBOD_BLOCK_SIZE - currentAddr);
-      //subtracts the amount that was read from the remainingReadLen and adds it to numRead
-      remainingReadLen -= (JBOD_BLOCK_SIZE - currentAddr);
-      numRead += (JBOD_BLOCK_SIZE - currentAddr);
-      //sets the currentAddr to 0 since the next read will start at the start of a block
-      currentAddr = 0;
-      //primes the op for use in the write block method
-      op = encode(0, 0, JBOD_WRITE_BLOCK, 0);
 
-      if(cache_enabled())
-      {
-        //calls cache_lookup to check if the block is already in the cache
-        readCacheCheck = cache_lookup(diskID, blockID, tempBuffer);
-        //if the block is currently not in the cache, writes it to the cache
-        if (readCacheCheck == -1)
-        {
-          cache_insert(diskID, blockID, buffer);
-        }
-        //if the block is currently in the cache, updates it instead
-        else
-        {
-          cache_update(diskID, blockID, buffer);
-        }
-      }
 
-      //calls write block method to write the data into the JBOD
-      writeBlockCheck = jbod_client_operation(op, buffer);
-      //calls mdadm_read to read a copy of the next block into buffer
-      int readBlockCheck = mdadm_read(startAddrOfBlock + JBOD_BLOCK_SIZE, JBOD_BLOCK_SIZE, buffer);
-      //increments blockID by 1 
-      blockID++;
-      //returns -1 if the block reading fails
-      if (writeBlockCheck == -1 || readBlockCheck == -1)
-      {
-        return -1;
-      }
+//helper method that journals count blocks as one record, their images in data and their places in the volume in
+//targets: once it returns 1 the record is durable, and a crash leaves all of the blocks written or none of them.
+//the journal is checkpointed first if the record does not fit
+static int jnlAppend(mdadm_ctx_t *ctx, int count, const uint32_t *targets, const uint8_t *data)
+{
+  //a block is journaled at most once per journal block, so the dirty map never holds more than jnlBlocks
+  if (ctx->jnlHead + 1 + count > ctx->jnlBlocks && jnlCheckpoint(ctx) == -1)
+  {
+    return -1;
+  }
+  trace_begin("jnl_append");
+  trace_arg("blocks", count);
+  jnl_header_t header = { .magic = JNL_MAGIC, .epoch = ctx->jnlEpoch, .count = count };
+  memcpy(header.targets, targets, count * sizeof(uint32_t));
+  header.checksum = fnv1a(fnv1a(FNV_OFFSET_BASIS, (const uint8_t *)&header, sizeof(header)), data,
+                          (size_t)count * JBOD_BLOCK_SIZE);
+  uint8_t record[(1 + JNL_RECORD_BLOCKS) * JBOD_BLOCK_SIZE];
+  memcpy(record, &header, sizeof(header));
+  memcpy(record + JBOD_BLOCK_SIZE, data, (size_t)count * JBOD_BLOCK_SIZE);
+
+  //the header and data are one sequential write wherever the blocks are headed
+  int rc = -1;
+  if (storeBlocks(ctx, ctx->jnlStart + ctx->jnlHead, 1 + count, record) == 1 &&
+      ctx->backend->ops->flush(ctx->backend) == 0)
+  {
+    ctx->jnlHead += 1 + count;
+    for (int i = 0; i < count; i++)
+    {
+      jnlDirtyPut(ctx, targets[i], data + i * JBOD_BLOCK_SIZE);
+      keepWritten(ctx, targets[i], 1, data + i * JBOD_BLOCK_SIZE);
     }
+    rc = 1;
+  }
+  trace_end();
+  return rc;
+}
 
 
-    //if the read stays within the current block
-    else if((currentAddr + remainingReadLen) <= JBOD_BLOCK_SIZE)
-    {
-      //replace the required values from buffer using memcpy
-      memcpy(&buffer[currentAddr], &buf[numRead], remainingReadLen);
-      //primes the op for use in the write block method
-      op = encode(0, 0, JBOD_WRITE_BLOCK, 0);
 
-      if(cache_enabled())
-      {
-        //calls cache_lookup to check if the block is already in the cache
-        readCacheCheck = cache_lookup(diskID, blockID, tempBuffer);
-        //if the block is currently not in the cache, writes it to the cache
-        if (readCacheCheck == -1)
-        {
-          cache_insert(diskID, blockID, buffer);
+//helper method that waits on jnlCond, until deadlineNs if it is not 0. The call's QoS turn is handed back first so
+//the writers it waits for can get in; from then on the call carries on under the lock alone. Calls that run meanwhile
+//set their own deadline on the backend, so the call's is put back afterwards. Returns -1 once deadlineNs has passed
+static int jnlWait(mdadm_ctx_t *ctx, int64_t deadlineNs)
+{
+  int64_t callDeadline = ctx->deadline;
+  qos_release(&ctx->qos, &ctx->ticket);
+  ctx->ticket.scheduled = false;
+  if (deadlineNs == 0)
+  {
+    pthread_cond_wait(&ctx->jnlCond, &ctx->lock);
+  }
+  else
+  {
+    //the condition variable keeps CLOCK_REALTIME, so the deadline is moved over
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    int64_t abs = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec + (deadlineNs - monotonic_ns());
+    ts.tv_sec = abs / 1000000000;
+    ts.tv_nsec = abs % 1000000000;
+    pthread_cond_timedwait(&ctx->jnlCond, &ctx->lock, &ts);
+  }
+  //calls that ran meanwhile left their own tickets behind, already released
+  ctx->ticket.scheduled = false;
+  ctx->deadline = callDeadline;
+  ctx->backend->ops->set_deadline(ctx->backend, callDeadline);
+  return (deadlineNs != 0 && monotonic_ns() >= deadlineNs) ? -1 : 1;
+}
+
+
+
+//helper method that journals the group commit gathered so far as one record and hands every write in it the result
+static void jnlCommitBatch(mdadm_ctx_t *ctx)
+{
+  if (ctx->jnlBatchCount == 0)
+  {
+    return;
+  }
+  int rc = jnlAppend(ctx, ctx->jnlBatchCount, ctx->jnlBatchBlocks, ctx->jnlBatchData);
+  for (int i = 0; i < ctx->jnlNumWaiters; i++)
+  {
+    *ctx->jnlWaiters[i] = rc;
+  }
+  ctx->jnlBatchCount = 0;
+  ctx->jnlNumWaiters = 0;
+  pthread_cond_broadcast(&ctx->jnlCond);
+}
+
+
+
+//helper method that empties the journal into the volume: the group commit being gathered goes out, then everything
+//journaled goes home
+static int jnlDrain(mdadm_ctx_t *ctx)
+{
+  if (!ctx->jnlActive)
+  {
+    return 1;
+  }
+  jnlCommitBatch(ctx);
+  return jnlCheckpoint(ctx);
+}
+
+
+
+//helper method that waits until the group commit being gathered has room for count more blocks. It comes before a
+//write reads its partial blocks, so nothing can be written to them between the read and joining the batch, and fails
+//once the call's deadline passes
+static int jnlMakeRoom(mdadm_ctx_t *ctx, int count)
+{
+  while (ctx->jnlBatchCount + count > JNL_RECORD_BLOCKS || ctx->jnlNumWaiters == JNL_MAX_WAITERS)
+  {
+    //a full batch is the leader's cue to stop gathering
+    pthread_cond_broadcast(&ctx->jnlCond);
+    if (jnlWait(ctx, ctx->deadline) == -1)
+    {
+      return -1;
+    }
+  }
+  //the volume may have been unmounted meanwhile
+  return (ctx->isMounted && ctx->jnlActive) ? 1 : -1;
+}
+
+
+
+//helper method that lays the blocks of the group commit being gathered over their images among count blocks from
+//firstBlock, so a write that shares a block with one waiting in the batch keeps its bytes
+static void jnlBatchOverlay(mdadm_ctx_t *ctx, uint32_t firstBlock, int count, uint8_t *buffer)
+{
+  for (int i = 0; i < ctx->jnlBatchCount; i++)
+  {
+    if (ctx->jnlBatchBlocks[i] - firstBlock < (uint32_t)count)
+    {
+      memcpy(buffer + (ctx->jnlBatchBlocks[i] - firstBlock) * JBOD_BLOCK_SIZE, ctx->jnlBatchData + i * JBOD_BLOCK_SIZE,
+             JBOD_BLOCK_SIZE);
+    }
+  }
+}
+
+
+
+//helper method that takes result off the writes waiting for the group commit being gathered
+static void jnlDropWaiter(mdadm_ctx_t *ctx, int *result)
+{
+  for (int i = 0; i < ctx->jnlNumWaiters; i++)
+  {
+    if (ctx->jnlWaiters[i] == result)
+    {
+      ctx->jnlWaiters[i] = ctx->jnlWaiters[--ctx->jnlNumWaiters];
+      return;
+    }
+  }
+}
+
+
+
+//helper method that journals count block images from firstBlock by group commit. The first write into an empty batch
+//leads: while other writers are queued for the lock it waits for them to add their blocks, up to a short window,
+//then journals the lot as one record. The writes that joined wait for the leader to hand them the result, or fail
+//when their own deadline comes first
+static int jnlGroupCommit(mdadm_ctx_t *ctx, uint32_t firstBlock, int count, const uint8_t *image)
+{
+  //a later write to a block in the batch replaces it, since the image it was built from includes the earlier one
+  for (int i = 0; i < count; i++)
+  {
+    int slot = 0;
+    while (slot < ctx->jnlBatchCount && ctx->jnlBatchBlocks[slot] != firstBlock + i)
+    {
+      slot++;
+    }
+    if (slot == ctx->jnlBatchCount)
+    {
+      ctx->jnlBatchBlocks[ctx->jnlBatchCount++] = firstBlock + i;
+    }
+    memcpy(ctx->jnlBatchData + slot * JBOD_BLOCK_SIZE, image + i * JBOD_BLOCK_SIZE, JBOD_BLOCK_SIZE);
+  }
+  //0 until the batch goes out
+  int result = 0;
+  ctx->jnlWaiters[ctx->jnlNumWaiters++] = &result;
+  pthread_cond_broadcast(&ctx->jnlCond);
+
+  if (ctx->jnlLeader)
+  {
+    trace_begin("jnl_group_wait");
+    while (result == 0)
+    {
+      //a write that gives up leaves its blocks to the batch, but the leader must not hand it a result any more
+      if (jnlWait(ctx, ctx->deadline) == -1 && result == 0)
+      {
+        jnlDropWaiter(ctx, &result);
+        result = -1;
+      }
+    }
+    trace_end();
+    return result;
+  }
+
+  ctx->jnlLeader = true;
+  trace_begin("jnl_group_gather");
+  int64_t deadline = monotonic_ns() + JNL_GROUP_WINDOW_NS;
+  if (ctx->deadline != 0 && ctx->deadline < deadline)
+  {
+    deadline = ctx->deadline;
+  }
+  while (result == 0 && atomic_load(&ctx->writersWaiting) > 0 && ctx->jnlBatchCount + MAX_IO_BLOCKS <= JNL_RECORD_BLOCKS &&
+         ctx->jnlNumWaiters < JNL_MAX_WAITERS && monotonic_ns() < deadline)
+  {
+    jnlWait(ctx, deadline);
+  }
+  trace_arg("writes", ctx->jnlNumWaiters);
+  trace_end();
+  //a flush or unmount meanwhile may have sent this write out already, and writes that joined since are still waiting
+  jnlCommitBatch(ctx);
+  ctx->jnlLeader = false;
+  return result;
+}
+
+
+
+//helper method that finds the write-combining slot holding globalBlock, or NULL if there is none
+static wc_slot_t *wcFind(mdadm_ctx_t *ctx, uint32_t globalBlock)
+{
+  for (int i = 0; i < ctx->wcMaxSlots; i++)
+  {
+    if (ctx->wcSlots[i].used && ctx->wcSlots[i].globalBlock == globalBlock)
+    {
+      return &ctx->wcSlots[i];
+    }
+  }
+  return NULL;
+}
+
+
+
+//helper method used by qsort to put slot pointers in volume order
+static int wcCompare(const void *a, const void *b)
+{
+  const wc_slot_t *slotA = *(wc_slot_t * const *)a;
+  const wc_slot_t *slotB = *(wc_slot_t * const *)b;
+  return (slotA->globalBlock > slotB->globalBlock) - (slotA->globalBlock < slotB->globalBlock);
+}
+
+
+
+//helper method that writes every block in the write-combining buffer except keep (which may be NULL)
+//to the JBOD. blocks go out in disk/block order so neighbours share one run, and partially written
+//blocks are completed from the cache or the JBOD first. Blocks stay buffered if the write fails.
+static int wcFlushExcept(mdadm_ctx_t *ctx, wc_slot_t *keep)
+{
+  //sorts the used slots by their place on the volume
+  wc_slot_t *order[WC_MAX_SLOTS];
+  int numUsed = 0;
+  for (int i = 0; i < ctx->wcMaxSlots; i++)
+  {
+    if (ctx->wcSlots[i].used && &ctx->wcSlots[i] != keep)
+    {
+      order[numUsed++] = &ctx->wcSlots[i];
+    }
+  }
+  if (numUsed == 0)
+  {
+    return 1;
+  }
+  qsort(order, numUsed, sizeof(wc_slot_t *), wcCompare);
+
+  //builds whole block images, reading back only the bytes nobody wrote
+  uint8_t image[WC_MAX_SLOTS * JBOD_BLOCK_SIZE];
+  for (int i = 0; i < numUsed; i++)
+  {
+    wc_slot_t *slot = order[i];
+    uint8_t *dst = image + i * JBOD_BLOCK_SIZE;
+    if (slot->numWritten < JBOD_BLOCK_SIZE)
+    {
+      if (readBlocks(ctx, slot->globalBlock, 1, dst) == -1)
+      {
+        return -1;
+      }
+      for (int j = 0; j < JBOD_BLOCK_SIZE; j++)
+      {
+        if (slot->written[j])
+        {
+          dst[j] = slot->data[j];
         }
-        //if the block is currently in the cache, updates it instead
-        else
+      }
+    }
+    else
+    {
+      memcpy(dst, slot->data, JBOD_BLOCK_SIZE);
+    }
+  }
+
+  //with a journal the whole buffer is one record (WC_MAX_SLOTS fits in one), so a flush is atomic too
+  if (ctx->jnlActive)
+  {
+    uint32_t targets[WC_MAX_SLOTS];
+    for (int i = 0; i < numUsed; i++)
+    {
+      targets[i] = order[i]->globalBlock;
+    }
+    if (jnlAppend(ctx, numUsed, targets, image) == -1)
+    {
+      return -1;
+    }
+  }
+  else
+  {
+    //otherwise writes each run of neighbouring blocks together
+    int start = 0;
+    for (int i = 1; i <= numUsed; i++)
+    {
+      if (i == numUsed || order[i]->globalBlock != order[i - 1]->globalBlock + 1)
+      {
+        if (writeBlocks(ctx, order[start]->globalBlock, i - start, image + start * JBOD_BLOCK_SIZE) == -1)
         {
-          cache_update(diskID, blockID, buffer);
+          return -1;
         }
+        start = i;
       }
+    }
+  }
 
-      //calls write block method to write info from buffer into blocks
-      writeBlockCheck = jbod_client_operation(op, buffer);
-      //adjusts numRead and remainingReadLen accordingly
-      numRead += remainingReadLen;
-      remainingReadLen = 0;
-      //returns -1 if any of the checks failed
-      if (writeBlockCheck == -1)
+  for (int i = 0; i < numUsed; i++)
+  {
+    order[i]->used = false;
+  }
+  ctx->wcUsed -= numUsed;
+  //a block kept back starts a new window
+  ctx->wcOpenedNs = monotonic_ns();
+  return 1;
+}
+
+
+
+//helper method that writes every block in the write-combining buffer to the JBOD
+static int wcFlush(mdadm_ctx_t *ctx)
+{
+  return wcFlushExcept(ctx, NULL);
+}
+
+
+
+//helper method that flushes the write-combining buffer once its time window has run out
+static int wcExpire(mdadm_ctx_t *ctx)
+{
+  if (ctx->wcUsed > 0 && monotonic_ns() - ctx->wcOpenedNs >= (int64_t)ctx->wcWindowMs * 1000000)
+  {
+    return wcFlush(ctx);
+  }
+  return 1;
+}
+
+
+
+//helper method that copies len bytes of buf into the write-combining buffer at addr,
+//flushing it first whenever it has no room for another block
+static int wcAdd(mdadm_ctx_t *ctx, uint32_t addr, uint32_t len, const uint8_t *buf)
+{
+  uint32_t numAdded = 0;
+  while (numAdded < len)
+  {
+    uint32_t curAddr = addr + numAdded;
+    uint32_t globalBlock = curAddr / JBOD_BLOCK_SIZE;
+    uint32_t offset = curAddr % JBOD_BLOCK_SIZE;
+    uint32_t chunk = JBOD_BLOCK_SIZE - offset;
+    if (chunk > len - numAdded)
+    {
+      chunk = len - numAdded;
+    }
+
+    wc_slot_t *slot = wcFind(ctx, globalBlock);
+    if (slot == NULL && ctx->wcUsed > 0)
+    {
+      //moving to another disk means seeking back later for whatever is buffered, so that goes out now
+      int lastDisk, newDisk, unused;
+      jbod_geometry_locate(&ctx->geometry, ctx->wcLast->globalBlock, &lastDisk, &unused);
+      jbod_geometry_locate(&ctx->geometry, globalBlock, &newDisk, &unused);
+      if (lastDisk != newDisk && wcFlush(ctx) == -1)
       {
         return -1;
       }
     }
+    if (slot == NULL)
+    {
+      //the block written last is likely still being filled, so it stays behind when the buffer is full
+      if (ctx->wcUsed == ctx->wcMaxSlots && wcFlushExcept(ctx, (ctx->wcMaxSlots > 1) ? ctx->wcLast : NULL) == -1)
+      {
+        return -1;
+      }
+      for (int i = 0; i < ctx->wcMaxSlots; i++)
+      {
+        if (!ctx->wcSlots[i].used)
+        {
+          slot = &ctx->wcSlots[i];
+          break;
+        }
+      }
+      slot->used = true;
+      slot->globalBlock = globalBlock;
+      slot->numWritten = 0;
+      memset(slot->written, 0, sizeof(slot->written));
+      if (ctx->wcUsed++ == 0)
+      {
+        ctx->wcOpenedNs = monotonic_ns();
+      }
+    }
+
+    ctx->wcLast = slot;
+    //later bytes replace earlier ones, which is what merges overlapping writes
+    memcpy(slot->data + offset, &buf[numAdded], chunk);
+    for (uint32_t j = offset; j < offset + chunk; j++)
+    {
+      if (!slot->written[j])
+      {
+        slot->written[j] = true;
+        slot->numWritten++;
+      }
+    }
+    numAdded += chunk;
   }
+  return 1;
+}
 
-  return len;
-}
\ No newline at end of file
+
+
+//helper method that lays whatever the write-combining buffer holds for count blocks,
+//starting at firstBlock, over their images in buffer
+static void wcOverlay(mdadm_ctx_t *ctx, uint32_t firstBlock, int count, uint8_t *buffer)
+{
+  for (int i = 0; i < count; i++)
+  {
+    wc_slot_t *slot = wcFind(ctx, firstBlock + i);
+    if (slot == NULL)
+    {
+      continue;
+    }
+    uint8_t *dst = buffer + i * JBOD_BLOCK_SIZE;
+    for (int j = 0; j < JBOD_BLOCK_SIZE; j++)
+    {
+      if (slot->written[j])
+      {
+        dst[j] = slot->data[j];
+      }
+    }
+  }
+}
+
+
+
+//helper method that checks the input of mdadm_read and determines if it is valid or not
+bool inputCheck(uint32_t numBlocks, uint32_t addr, uint32_t len, bool isNull)
+{
+  bool invalidInput = false;
+  uint64_t volumeSize = (uint64_t)numBlocks * JBOD_BLOCK_SIZE;
+  //checks to see if the address is out of bounds or if the input is otherwise invalid
+  if ((uint64_t)addr + len > volumeSize || len > 1024)
+  {
+    invalidInput = true;
+  }
+  //if read is passed a NULL pointer and non-zero length, it is invalid
+  if (isNull && len != 0)
+  {
+    invalidInput = true;
+  }
+  return invalidInput;
+}
+
+
+
+//helper method that forgets the journal of this mount
+static void jnlClose(mdadm_ctx_t *ctx)
+{
+  free(ctx->jnlDirtyBlocks);
+  free(ctx->jnlDirtyData);
+  free(ctx->jnlDirtyIndex);
+  free(ctx->jnlOrder);
+  ctx->jnlDirtyBlocks = NULL;
+  ctx->jnlDirtyData = NULL;
+  ctx->jnlDirtyIndex = NULL;
+  ctx->jnlOrder = NULL;
+  ctx->jnlDirtyCount = 0;
+  ctx->jnlActive = false;
+}
+
+
+
+//helper method that replays the journal: the records of the superblock's epoch are read in order up to the first one
+//that is torn or left over from an earlier epoch, and their blocks are checkpointed home. Without a valid superblock
+//the journal is new, and is started with an epoch taken from the clock, unlike whatever the region held before
+static int jnlReplay(mdadm_ctx_t *ctx)
+{
+  uint8_t record[(1 + JNL_RECORD_BLOCKS) * JBOD_BLOCK_SIZE];
+  if (exportBlocks(ctx, ctx->jnlStart, 1, record) == -1)
+  {
+    return -1;
+  }
+  jnl_super_t super;
+  memcpy(&super, record, sizeof(super));
+  if (super.magic != JNL_MAGIC || super.numBlocks != ctx->jnlBlocks ||
+      super.checksum != fnv1a(FNV_OFFSET_BASIS, (const uint8_t *)&super, offsetof(jnl_super_t, checksum)))
+  {
+    ctx->jnlEpoch = (uint32_t)time(NULL);
+    ctx->jnlHead = 1;
+    return jnlWriteSuper(ctx);
+  }
+
+  ctx->jnlEpoch = super.epoch;
+  ctx->jnlHead = 1;
+  while (ctx->jnlHead + 1 < ctx->jnlBlocks)
+  {
+    if (exportBlocks(ctx, ctx->jnlStart + ctx->jnlHead, 1, record) == -1)
+    {
+      return -1;
+    }
+    jnl_header_t header;
+    memcpy(&header, record, sizeof(header));
+    if (header.magic != JNL_MAGIC || header.epoch != ctx->jnlEpoch || header.count == 0 ||
+        header.count > JNL_RECORD_BLOCKS || ctx->jnlHead + 1 + header.count > ctx->jnlBlocks)
+    {
+      break;
+    }
+    uint8_t *data = record + JBOD_BLOCK_SIZE;
+    if (exportBlocks(ctx, ctx->jnlStart + ctx->jnlHead + 1, header.count, data) == -1)
+    {
+      return -1;
+    }
+    uint64_t checksum = header.checksum;
+    header.checksum = 0;
+    bool valid = fnv1a(fnv1a(FNV_OFFSET_BASIS, (const uint8_t *)&header, sizeof(header)), data,
+                       (size_t)header.count * JBOD_BLOCK_SIZE) == checksum;
+    for (uint32_t i = 0; i < header.count && valid; i++)
+    {
+      valid = header.targets[i] < ctx->jnlStart;
+    }
+    if (!valid)
+    {
+      break;
+    }
+    //the cache may still hold what was in place before the crash
+    for (uint32_t i = 0; i < header.count; i++)
+    {
+      jnlDirtyPut(ctx, header.targets[i], data + i * JBOD_BLOCK_SIZE);
+      if (cache_ctx_enabled(ctx->cache))
+      {
+        int diskID, blockID;
+        jbod_geometry_locate(&ctx->geometry, header.targets[i], &diskID, &blockID);
+        cache_ctx_invalidate(ctx->cache, diskID, blockID);
+      }
+    }
+    ctx->jnlHead += 1 + header.count;
+  }
+  trace_arg("blocks", ctx->jnlDirtyCount);
+  return jnlCheckpoint(ctx);
+}
+
+
+
+//helper method that sets up the journal in the last jnlConfigured blocks of the volume and replays it
+static int jnlOpen(mdadm_ctx_t *ctx)
+{
+  if ((uint32_t)ctx->jnlConfigured >= jbod_geometry_blocks(&ctx->geometry))
+  {
+    return -1;
+  }
+  ctx->jnlBlocks = ctx->jnlConfigured;
+  ctx->jnlStart = jbod_geometry_blocks(&ctx->geometry) - ctx->jnlBlocks;
+  //the index is at least twice as large as the most blocks it can hold
+  uint32_t indexSize = 1;
+  while (indexSize < 2 * ctx->jnlBlocks)
+  {
+    indexSize <<= 1;
+  }
+  ctx->jnlIndexMask = indexSize - 1;
+  ctx->jnlDirtyBlocks = malloc(ctx->jnlBlocks * sizeof(uint32_t));
+  ctx->jnlDirtyData = malloc((size_t)ctx->jnlBlocks * JBOD_BLOCK_SIZE);
+  ctx->jnlDirtyIndex = malloc(indexSize * sizeof(int32_t));
+  ctx->jnlOrder = malloc(ctx->jnlBlocks * sizeof(uint64_t));
+  ctx->jnlActive = true;
+  if (ctx->jnlDirtyBlocks == NULL || ctx->jnlDirtyData == NULL || ctx->jnlDirtyIndex == NULL || ctx->jnlOrder == NULL)
+  {
+    jnlClose(ctx);
+    return -1;
+  }
+  jnlDirtyClear(ctx);
+  ctx->curDisk = -1;
+  trace_begin("jnl_replay");
+  int rc = jnlReplay(ctx);
+  trace_end();
+  if (rc == -1)
+  {
+    jnlClose(ctx);
+  }
+  return rc;
+}
+
+
+
+static int mountLocked(mdadm_ctx_t *ctx)
+{
+  //if it is unmounted, mounts it and returns 1
+  if (ctx->isMounted)
+  {
+    return -1;
+  }
+  //calls encode helper method to make create op variable
+  uint32_t op = encode(0, 0, JBOD_MOUNT, 0);
+  if (ctx->backend->ops->operation(ctx->backend, op, NULL) == -1)
+  {
+    return -1;
+  }
+  //every address translation from here on depends on the shape of the array
+  if (ctx->backend->ops->geometry(ctx->backend, &ctx->geometry) == -1)
+  {
+    ctx->backend->ops->operation(ctx->backend, encode(0, 0, JBOD_UNMOUNT, 0), NULL);
+    return -1;
+  }
+  //whatever a crash left in the journal is replayed before anything reads the volume
+  if (ctx->jnlConfigured > 0 && jnlOpen(ctx) == -1)
+  {
+    ctx->backend->ops->operation(ctx->backend, encode(0, 0, JBOD_UNMOUNT, 0), NULL);
+    return -1;
+  }
+  //a volume whose writes are tracked is not mounted untracked, or a backup could miss them
+  if (ctx->cbtPath != NULL)
+  {
+    ctx->cbt = cbt_open(ctx->cbtPath, jbod_geometry_blocks(&ctx->geometry));
+    if (ctx->cbt == NULL)
+    {
+      jnlClose(ctx);
+      ctx->backend->ops->operation(ctx->backend, encode(0, 0, JBOD_UNMOUNT, 0), NULL);
+      return -1;
+    }
+  }
+  ctx->isMounted = true;
+  ctx->curDisk = -1;
+  return 1;
+}
+
+
+
+static int unmountLocked(mdadm_ctx_t *ctx)
+{
+  //if it is mounted, unmounts it and returns 1
+  if (!ctx->isMounted)
+  {
+    return -1;
+  }
+  //buffered writes have to reach the JBOD before it goes away, and the journal is emptied so the next mount has
+  //nothing to replay
+  if (wcFlush(ctx) == -1 || jnlDrain(ctx) == -1)
+  {
+    return -1;
+  }
+  jnlClose(ctx);
+  cbt_close(ctx->cbt);
+  ctx->cbt = NULL;
+  ctx->isMounted = false;
+  //advice is about this mount's volume
+  ctx->numAdvice = 0;
+  pthread_mutex_lock(&ctx->prefetchLock);
+  ctx->prefetchLen = 0;
+  pthread_mutex_unlock(&ctx->prefetchLock);
+  ctx->curDisk = -1;
+  //calls encode helper method to make create op variable
+  uint32_t op = encode(0, 0, JBOD_UNMOUNT, 0);
+  ctx->backend->ops->operation(ctx->backend, op, NULL);
+  return 1;
+}
+
+
+
+//helper method that reads the uncached blocks among count blocks from firstBlock into the cache, in runs that stop
+//at the end of a disk; returns 1 on success and -1 on failure
+static int fillCache(mdadm_ctx_t *ctx, uint32_t firstBlock, int count)
+{
+  uint8_t buffer[PREFETCH_RUN_BLOCKS * JBOD_BLOCK_SIZE];
+  int i = 0;
+  while (i < count)
+  {
+    int diskID, blockID;
+    jbod_geometry_locate(&ctx->geometry, firstBlock + i, &diskID, &blockID);
+    if (cache_ctx_contains(ctx->cache, diskID, blockID))
+    {
+      i++;
+      continue;
+    }
+    int run = 1;
+    while (i + run < count && run < PREFETCH_RUN_BLOCKS && blockID + run < (int)ctx->geometry.blocks_per_disk &&
+           !cache_ctx_contains(ctx->cache, diskID, blockID + run))
+    {
+      run++;
+    }
+    if (fetchRun(ctx, diskID, blockID, run, buffer) == -1)
+    {
+      return -1;
+    }
+    for (int j = 0; j < run; j++)
+    {
+      cache_ctx_insert(ctx->cache, diskID, blockID + j, buffer + j * JBOD_BLOCK_SIZE);
+    }
+    i += run;
+  }
+  return 1;
+}
+
+
+
+//helper method that follows a read of addr/len ending in a SEQUENTIAL range: the blocks the read is done with go
+//to the cold end of the cache, and the blocks after it are read ahead once fewer than half the window are cached
+static void sequentialRead(mdadm_ctx_t *ctx, uint32_t addr, uint32_t len)
+{
+  if (!cache_ctx_enabled(ctx->cache) || mapped(ctx))
+  {
+    return;
+  }
+  //the last block is only done with if the read ran to its end
+  uint32_t endBlock = (addr + len) / JBOD_BLOCK_SIZE;
+  for (uint32_t b = addr / JBOD_BLOCK_SIZE; b < endBlock; b++)
+  {
+    if (adviceFor(ctx, b) == MDADM_ADVICE_SEQUENTIAL)
+    {
+      int diskID, blockID;
+      jbod_geometry_locate(&ctx->geometry, b, &diskID, &blockID);
+      cache_ctx_demote(ctx->cache, diskID, blockID);
+    }
+  }
+
+  //the window ends at the end of the volume or of the advice
+  uint32_t next = (addr + len - 1) / JBOD_BLOCK_SIZE + 1;
+  uint32_t end = next;
+  while (end - next < READAHEAD_BLOCKS && end < volumeBlocks(ctx) &&
+         adviceFor(ctx, end) == MDADM_ADVICE_SEQUENTIAL)
+  {
+    end++;
+  }
+  uint32_t ahead = next;
+  while (ahead < end)
+  {
+    int diskID, blockID;
+    jbod_geometry_locate(&ctx->geometry, ahead, &diskID, &blockID);
+    if (!cache_ctx_contains(ctx->cache, diskID, blockID))
+    {
+      break;
+    }
+    ahead++;
+  }
+  //a failed read-ahead does not fail the read; the blocks are read when asked for
+  if (ahead < end && ahead - next < READAHEAD_BLOCKS / 2)
+  {
+    fillCache(ctx, ahead, end - ahead);
+  }
+}
+
+
+
+static int readLocked(mdadm_ctx_t *ctx, uint32_t addr, uint32_t len, uint8_t *buf)
+{
+  //calls helper method to determine if the input is invalid
+  bool invalidInput = inputCheck(volumeBlocks(ctx), addr, len, buf == NULL);
+
+  //returns -1 if the input is invalid or if read is called when it is unmounted 
+  if (invalidInput || !ctx->isMounted)
+  {
+    return -1;
+  }
+  if (len == 0)
+  {
+    return 0;
+  }
+
+  //finds the first and last block the read touches
+  uint32_t firstBlock = addr / JBOD_BLOCK_SIZE;
+  uint32_t lastBlock = (addr + len - 1) / JBOD_BLOCK_SIZE;
+  int count = lastBlock - firstBlock + 1;
+
+  if (wcExpire(ctx) == -1)
+  {
+    return -1;
+  }
+
+  //with nothing buffered, a mapped backend's bytes go straight into buf without an intermediate image
+  if (mapped(ctx) && ctx->wcUsed == 0)
+  {
+    uint32_t numRead = 0;
+    while (numRead < len)
+    {
+      int diskID, blockID;
+      uint32_t offset = (addr + numRead) % JBOD_BLOCK_SIZE;
+      uint32_t chunk = JBOD_BLOCK_SIZE - offset;
+      if (chunk > len - numRead)
+      {
+        chunk = len - numRead;
+      }
+      jbod_geometry_locate(&ctx->geometry, (addr + numRead) / JBOD_BLOCK_SIZE, &diskID, &blockID);
+      const uint8_t *src = ctx->backend->ops->block_ptr(ctx->backend, diskID, blockID);
+      if (src == NULL)
+      {
+        return -1;
+      }
+      memcpy(buf + numRead, src + offset, chunk);
+      numRead += chunk;
+    }
+    return len;
+  }
+
+  //reads every block the read touches into one buffer, then copies the requested range out of it.
+  //blocks the write-combining buffer holds in full are not read at all
+  uint8_t image[MAX_IO_BLOCKS * JBOD_BLOCK_SIZE];
+  int i = 0;
+  while (i < count)
+  {
+    wc_slot_t *slot = wcFind(ctx, firstBlock + i);
+    if (slot != NULL && slot->numWritten == JBOD_BLOCK_SIZE)
+    {
+      i++;
+      continue;
+    }
+    int run = 1;
+    while (i + run < count)
+    {
+      slot = wcFind(ctx, firstBlock + i + run);
+      if (slot != NULL && slot->numWritten == JBOD_BLOCK_SIZE)
+      {
+        break;
+      }
+      run++;
+    }
+    if (readBlocks(ctx, firstBlock + i, run, image + i * JBOD_BLOCK_SIZE) == -1)
+    {
+      return -1;
+    }
+    i += run;
+  }
+  //reads see writes that are still buffered
+  wcOverlay(ctx, firstBlock, count, image);
+  memcpy(buf, image + (addr % JBOD_BLOCK_SIZE), len);
+  if (ctx->numAdvice > 0 && adviceFor(ctx, lastBlock) == MDADM_ADVICE_SEQUENTIAL)
+  {
+    sequentialRead(ctx, addr, len);
+  }
+  return len;
+}
+
+
+
+//helper method that gives back numRefs references lent out by readRefLocked
+static void releaseRefs(mdadm_ctx_t *ctx, mdadm_ref_t *refs, int numRefs)
+{
+  for (int i = 0; i < numRefs; i++)
+  {
+    if (refs[i].pinned != NULL)
+    {
+      cache_ctx_unpin(ctx->cache, refs[i].pinned);
+    }
+    free(refs[i].copy);
+    refs[i].pinned = NULL;
+    refs[i].copy = NULL;
+    refs[i].data = NULL;
+    refs[i].len = 0;
+  }
+}
+
+
+
+static int readRefLocked(mdadm_ctx_t *ctx, uint32_t addr, uint32_t len, mdadm_ref_t *refs, int maxRefs)
+{
+  //calls helper method to determine if the input is invalid
+  bool invalidInput = inputCheck(volumeBlocks(ctx), addr, len, refs == NULL);
+
+  //returns -1 if the input is invalid or if read is called when it is unmounted
+  if (invalidInput || !ctx->isMounted)
+  {
+    return -1;
+  }
+  if (len == 0)
+  {
+    return 0;
+  }
+
+  //one reference per block the read touches
+  uint32_t firstBlock = addr / JBOD_BLOCK_SIZE;
+  int count = (addr + len - 1) / JBOD_BLOCK_SIZE - firstBlock + 1;
+  if (count > maxRefs)
+  {
+    return -1;
+  }
+
+  //buffered writes would have to be laid over the blocks, so they go out first
+  if (ctx->wcUsed > 0 && wcFlush(ctx) == -1)
+  {
+    return -1;
+  }
+
+  bool useCache = cache_ctx_enabled(ctx->cache);
+  uint32_t numRead = 0;
+  for (int i = 0; i < count; i++)
+  {
+    int diskID, blockID;
+    uint32_t offset = (addr + numRead) % JBOD_BLOCK_SIZE;
+    uint32_t chunk = JBOD_BLOCK_SIZE - offset;
+    if (chunk > len - numRead)
+    {
+      chunk = len - numRead;
+    }
+    jbod_geometry_locate(&ctx->geometry, firstBlock + i, &diskID, &blockID);
+    refs[i].pinned = NULL;
+    refs[i].copy = NULL;
+
+    //a mapped backend's blocks and a private cache's hits are read in place; anything else gets a copy of its own
+    const uint8_t *block = NULL;
+    if (mapped(ctx))
+    {
+      block = ctx->backend->ops->block_ptr(ctx->backend, diskID, blockID);
+    }
+    else if (useCache && !cache_ctx_is_shared(ctx->cache))
+    {
+      block = refs[i].pinned = cache_ctx_lookup_pinned(ctx->cache, diskID, blockID);
+    }
+    if (block == NULL && !mapped(ctx))
+    {
+      refs[i].copy = malloc(JBOD_BLOCK_SIZE);
+      if (refs[i].copy != NULL)
+      {
+        //a shared cache's hit is copied out; a miss is fetched and fills the cache for next time
+        if (useCache && cache_ctx_is_shared(ctx->cache) && cache_ctx_lookup(ctx->cache, diskID, blockID, refs[i].copy) == 1)
+        {
+          block = refs[i].copy;
+        }
+        else if (fetchRun(ctx, diskID, blockID, 1, refs[i].copy) == 1)
+        {
+          if (useCache && adviceFor(ctx, firstBlock + i) != MDADM_ADVICE_NOREUSE)
+          {
+            cache_ctx_insert(ctx->cache, diskID, blockID, refs[i].copy);
+          }
+          block = refs[i].copy;
+        }
+      }
+    }
+    if (block == NULL)
+    {
+      releaseRefs(ctx, refs, i + 1);
+      return -1;
+    }
+    refs[i].data = block + offset;
+    refs[i].len = chunk;
+    numRead += chunk;
+  }
+  return count;
+}
+
+
+
+static int writeLocked(mdadm_ctx_t *ctx, uint32_t addr, uint32_t len, const uint8_t *buf)
+{
+  //calls helper method to determine if the input is invalid
+  bool invalidInput = inputCheck(volumeBlocks(ctx), addr, len, buf == NULL);
+
+  //returns -1 if the input is invalid or if write is called when it is unmounted 
+  if (invalidInput || !ctx->isMounted)
+  {
+    return -1;
+  }
+  if (len == 0)
+  {
+    return 0;
+  }
+
+  //the blocks are marked changed before any of the bytes can reach the JBOD
+  if (ctx->cbt != NULL)
+  {
+    cbt_mark(ctx->cbt, addr / JBOD_BLOCK_SIZE, (addr + len - 1) / JBOD_BLOCK_SIZE - addr / JBOD_BLOCK_SIZE + 1);
+  }
+
+  //with write combining on, the bytes only go into the buffer; the JBOD sees them on the next flush
+  if (ctx->wcMaxSlots > 0)
+  {
+    if (wcExpire(ctx) == -1 || wcAdd(ctx, addr, len, buf) == -1)
+    {
+      return -1;
+    }
+    return len;
+  }
+
+  //finds the first and last block the write touches
+  uint32_t firstBlock = addr / JBOD_BLOCK_SIZE;
+  uint32_t lastBlock = (addr + len - 1) / JBOD_BLOCK_SIZE;
+  int count = lastBlock - firstBlock + 1;
+  uint32_t headOffset = addr % JBOD_BLOCK_SIZE;
+  uint32_t tailEnd = (addr + len) % JBOD_BLOCK_SIZE;
+
+  if (ctx->jnlActive && jnlMakeRoom(ctx, count) == -1)
+  {
+    return -1;
+  }
+
+  //partial blocks at either end have to be read first so the bytes around the write are preserved
+  uint8_t image[MAX_IO_BLOCKS * JBOD_BLOCK_SIZE];
+  if (headOffset != 0 && readBlocks(ctx, firstBlock, 1, image) == -1)
+  {
+    return -1;
+  }
+  if (tailEnd != 0 && !(count == 1 && headOffset != 0) &&
+      readBlocks(ctx, lastBlock, 1, image + (count - 1) * JBOD_BLOCK_SIZE) == -1)
+  {
+    return -1;
+  }
+
+  //lays the new bytes over the blocks and writes them all back; with a journal, as part of the next group commit
+  if (ctx->jnlActive)
+  {
+    jnlBatchOverlay(ctx, firstBlock, count, image);
+    memcpy(image + headOffset, buf, len);
+    return (jnlGroupCommit(ctx, firstBlock, count, image) == 1) ? (int)len : -1;
+  }
+  memcpy(image + headOffset, buf, len);
+  if (writeBlocks(ctx, firstBlock, count, image) == -1)
+  {
+    return -1;
+  }
+  return len;
+}
+
+
+
+mdadm_ctx_t *mdadm_default_ctx(void)
+{
+  //the default context is bound lazily so it follows jbod_connect and cache_create. Calls read these under the lock,
+  //and a mount on another thread may be switching the backend, so they are only changed under it too
+  pthread_mutex_lock(&defaultCtx.lock);
+  defaultCtx.ownBackend = jbod_backend_default();
+  if (defaultCtx.backend == NULL)
+  {
+    defaultCtx.backend = defaultCtx.ownBackend;
+  }
+  defaultCtx.cache = cache_default();
+  pthread_mutex_unlock(&defaultCtx.lock);
+  return &defaultCtx;
+}
+
+
+
+//helper method behind mdadm_open and mdadm_open_shared; cacheName is NULL for a private cache
+static mdadm_ctx_t *openCtx(const char *ip, uint16_t port, const char *cacheName, int cache_entries)
+{
+  mdadm_ctx_t *ctx = calloc(1, sizeof(mdadm_ctx_t));
+  if (ctx == NULL)
+  {
+    return NULL;
+  }
+  pthread_mutex_init(&ctx->lock, NULL);
+  qos_init(&ctx->qos);
+  ctx->curDisk = -1;
+  ctx->curBlock = -1;
+
+  //connects the context's own connection to the server
+  ctx->ownBackend = jbod_backend_net_open(ip, port);
+  if (ctx->ownBackend == NULL)
+  {
+    qos_destroy(&ctx->qos);
+    pthread_mutex_destroy(&ctx->lock);
+    free(ctx);
+    return NULL;
+  }
+  ctx->ownsBackend = true;
+  ctx->backend = ctx->ownBackend;
+
+  //creates a private cache, or joins a shared one, if one was asked for
+  if (cache_entries > 0)
+  {
+    ctx->cache = cacheName ? cache_ctx_create_shared(cacheName, cache_entries) : cache_ctx_create(cache_entries);
+    ctx->ownsCache = true;
+    if (ctx->cache == NULL)
+    {
+      jbod_backend_close(ctx->ownBackend);
+      qos_destroy(&ctx->qos);
+      pthread_mutex_destroy(&ctx->lock);
+      free(ctx);
+      return NULL;
+    }
+  }
+  pthread_mutex_init(&ctx->prefetchLock, NULL);
+  pthread_cond_init(&ctx->prefetchCond, NULL);
+  pthread_cond_init(&ctx->jnlCond, NULL);
+  return ctx;
+}
+
+
+
+mdadm_ctx_t *mdadm_open(const char *ip, uint16_t port, int cache_entries)
+{
+  return openCtx(ip, port, NULL, cache_entries);
+}
+
+
+
+mdadm_ctx_t *mdadm_open_shared(const char *ip, uint16_t port, const char *cache_name, int cache_entries)
+{
+  if (cache_name == NULL)
+  {
+    return NULL;
+  }
+  return openCtx(ip, port, cache_name, cache_entries);
+}
+
+
+
+int mdadm_close(mdadm_ctx_t *ctx)
+{
+  //the default context is never freed
+  if (ctx == NULL || ctx == &defaultCtx)
+  {
+    return -1;
+  }
+  //the prefetch thread finishes the run it is on and goes
+  pthread_mutex_lock(&ctx->prefetchLock);
+  ctx->prefetchStop = true;
+  pthread_cond_signal(&ctx->prefetchCond);
+  pthread_mutex_unlock(&ctx->prefetchLock);
+  if (ctx->prefetchStarted)
+  {
+    pthread_join(ctx->prefetchThread, NULL);
+  }
+
+  pthread_mutex_lock(&ctx->lock);
+  if (ctx->isMounted)
+  {
+    unmountLocked(ctx);
+  }
+  //a journal that could not be emptied is replayed by the next mount
+  jnlClose(ctx);
+  pthread_mutex_unlock(&ctx->lock);
+
+  free(ctx->cbtPath);
+  if (ctx->ownsBackend)
+  {
+    jbod_backend_close(ctx->ownBackend);
+  }
+  if (ctx->ownsCache)
+  {
+    cache_ctx_destroy(ctx->cache);
+  }
+  qos_destroy(&ctx->qos);
+  pthread_cond_destroy(&ctx->jnlCond);
+  pthread_cond_destroy(&ctx->prefetchCond);
+  pthread_mutex_destroy(&ctx->prefetchLock);
+  pthread_mutex_destroy(&ctx->lock);
+  free(ctx);
+  return 1;
+}
+
+
+
+//helper method that waits for the calling tenant's turn, takes the context's lock and starts the clock on the
+//call's deadline; cost and bytes are what the call is expected to take from the JBOD, for the QoS scheduler
+static void beginRequest(mdadm_ctx_t *ctx, uint64_t cost, uint64_t bytes)
+{
+  //the deadline is taken before waiting for the lock, so time spent queued behind other callers counts
+  int64_t deadline = (ctx->timeoutMs > 0) ? monotonic_ns() + (int64_t)ctx->timeoutMs * 1000000 : 0;
+  qos_ticket_t ticket = { .tenant = currentTenant, .cost = cost, .bytes = bytes };
+  //time spent behind other tenants and callers shows up in traces on its own
+  trace_begin("wait_turn");
+  qos_acquire(&ctx->qos, &ticket);
+  pthread_mutex_lock(&ctx->lock);
+  trace_end();
+  ctx->ticket = ticket;
+  ctx->deadline = deadline;
+  ctx->backend->ops->set_deadline(ctx->backend, deadline);
+}
+
+
+
+//helper method for calls that move no data
+static void beginCall(mdadm_ctx_t *ctx)
+{
+  beginRequest(ctx, 0, 0);
+}
+
+
+
+//helper method that clears the call's deadline, releases the context's lock and lets the next tenant go
+static void endCall(mdadm_ctx_t *ctx)
+{
+  qos_ticket_t ticket = ctx->ticket;
+  ctx->deadline = 0;
+  ctx->backend->ops->set_deadline(ctx->backend, 0);
+  pthread_mutex_unlock(&ctx->lock);
+  qos_release(&ctx->qos, &ticket);
+}
+
+
+
+//helper method that opens the trace span of a read or write call on addr/len
+static void traceCall(const char *name, uint32_t addr, uint32_t len)
+{
+  trace_begin(name);
+  trace_arg("addr", addr);
+  trace_arg("len", len);
+}
+
+
+
+//helper method that estimates what a read or write costs the JBOD: a seek and every block it touches
+static uint64_t requestCost(uint32_t addr, uint32_t len, bool write)
+{
+  if (len == 0)
+  {
+    return 0;
+  }
+  uint64_t blocks = (addr + len - 1) / JBOD_BLOCK_SIZE - addr / JBOD_BLOCK_SIZE + 1;
+  return QOS_COST_SEEK + blocks * (write ? QOS_COST_WRITE_BLOCK : QOS_COST_READ_BLOCK);
+}
+
+
+
+int mdadm_ctx_set_timeout(mdadm_ctx_t *ctx, int timeout_ms)
+{
+  if (timeout_ms < 0)
+  {
+    return -1;
+  }
+  pthread_mutex_lock(&ctx->lock);
+  ctx->timeoutMs = timeout_ms;
+  pthread_mutex_unlock(&ctx->lock);
+  return 1;
+}
+
+
+
+int mdadm_ctx_set_write_combining(mdadm_ctx_t *ctx, int max_blocks, int window_ms)
+{
+  if (max_blocks < 0 || max_blocks > WC_MAX_SLOTS || window_ms < 0)
+  {
+    return -1;
+  }
+  beginCall(ctx);
+  //whatever is buffered goes out under the old settings, and a group commit being gathered goes out too, since the
+  //buffer does not look at it
+  jnlCommitBatch(ctx);
+  int rc = wcFlush(ctx);
+  if (rc == 1)
+  {
+    ctx->wcMaxSlots = max_blocks;
+    ctx->wcWindowMs = window_ms;
+  }
+  endCall(ctx);
+  return rc;
+}
+
+
+
+int mdadm_ctx_flush(mdadm_ctx_t *ctx)
+{
+  trace_begin("mdadm_flush");
+  beginCall(ctx);
+  int rc = 1;
+  if (ctx->isMounted)
+  {
+    //the buffered writes go to the backend, which then makes them durable; journaled writes already are, and the
+    //group commit being gathered goes out without waiting for more writers
+    jnlCommitBatch(ctx);
+    rc = wcFlush(ctx);
+    if (rc == 1 && ctx->backend->ops->flush(ctx->backend) == -1)
+    {
+      rc = -1;
+    }
+    //the change bitmaps are written out once the blocks they cover are durable
+    if (rc == 1 && ctx->cbt != NULL && cbt_sync(ctx->cbt) == -1)
+    {
+      rc = -1;
+    }
+  }
+  endCall(ctx);
+  trace_end();
+  return rc;
+}
+
+
+
+int mdadm_ctx_set_change_tracking(mdadm_ctx_t *ctx, const char *path)
+{
+  char *copy = NULL;
+  if (path != NULL && (copy = strdup(path)) == NULL)
+  {
+    return -1;
+  }
+  beginCall(ctx);
+  int rc = 1;
+  //the old tracker is written out and the new one takes over from the next write
+  cbt_close(ctx->cbt);
+  ctx->cbt = NULL;
+  free(ctx->cbtPath);
+  ctx->cbtPath = copy;
+  if (ctx->isMounted && copy != NULL)
+  {
+    ctx->cbt = cbt_open(copy, jbod_geometry_blocks(&ctx->geometry));
+    if (ctx->cbt == NULL)
+    {
+      free(ctx->cbtPath);
+      ctx->cbtPath = NULL;
+      rc = -1;
+    }
+  }
+  endCall(ctx);
+  return rc;
+}
+
+
+
+int mdadm_ctx_set_journal(mdadm_ctx_t *ctx, int num_blocks)
+{
+  if (num_blocks != 0 && num_blocks < JNL_MIN_BLOCKS)
+  {
+    return -1;
+  }
+  beginCall(ctx);
+  //the journal of the current mount, if any, stays until unmount
+  ctx->jnlConfigured = num_blocks;
+  endCall(ctx);
+  return 1;
+}
+
+
+
+int mdadm_ctx_begin_epoch(mdadm_ctx_t *ctx, uint32_t *epoch)
+{
+  if (epoch == NULL)
+  {
+    return -1;
+  }
+  beginCall(ctx);
+  int rc = -1;
+  if (ctx->cbt != NULL && cbt_begin_epoch(ctx->cbt, epoch) == 0)
+  {
+    rc = 1;
+  }
+  endCall(ctx);
+  return rc;
+}
+
+
+
+//helper method that reads count blocks for an export straight from the backend, so a backup does not flush the cache
+static int exportBlocks(mdadm_ctx_t *ctx, uint32_t firstBlock, int count, uint8_t *buffer)
+{
+  if (mapped(ctx))
+  {
+    return readBlocks(ctx, firstBlock, count, buffer);
+  }
+  int i = 0;
+  while (i < count)
+  {
+    int diskID, blockID;
+    jbod_geometry_locate(&ctx->geometry, firstBlock + i, &diskID, &blockID);
+    int run = count - i;
+    if (run > (int)ctx->geometry.blocks_per_disk - blockID)
+    {
+      run = ctx->geometry.blocks_per_disk - blockID;
+    }
+    if (run > JBOD_MAX_EXTENT_BLOCKS)
+    {
+      run = JBOD_MAX_EXTENT_BLOCKS;
+    }
+    if (fetchRun(ctx, diskID, blockID, run, buffer + i * JBOD_BLOCK_SIZE) == -1)
+    {
+      return -1;
+    }
+    i += run;
+  }
+  return 1;
+}
+
+
+
+int mdadm_ctx_export_changes(mdadm_ctx_t *ctx, uint32_t since, mdadm_export_fn fn, void *arg)
+{
+  if (fn == NULL)
+  {
+    return -1;
+  }
+  trace_begin("mdadm_export_changes");
+  trace_arg("since", since);
+  beginCall(ctx);
+  //buffered writes are already marked, so they have to be on the JBOD before it is read
+  if (ctx->cbt == NULL || !cbt_has_epoch(ctx->cbt, since) || wcFlush(ctx) == -1)
+  {
+    endCall(ctx);
+    trace_end();
+    return -1;
+  }
+
+  //runs come out in block order, which is disk then block, so the JBOD only ever seeks forward
+  uint8_t buffer[EXPORT_RUN_BLOCKS * JBOD_BLOCK_SIZE];
+  uint32_t from = 0, first, count;
+  int numExported = 0;
+  while (cbt_next_run(ctx->cbt, since, from, EXPORT_RUN_BLOCKS, &first, &count) == 1)
+  {
+    if (exportBlocks(ctx, first, count, buffer) == -1 ||
+        fn(arg, first * JBOD_BLOCK_SIZE, count * JBOD_BLOCK_SIZE, buffer) == -1)
+    {
+      numExported = -1;
+      break;
+    }
+    numExported += count;
+    from = first + count;
+  }
+  endCall(ctx);
+  trace_arg("blocks", numExported);
+  trace_end();
+  return numExported;
+}
+
+
+
+uint64_t mdadm_ctx_volume_size(mdadm_ctx_t *ctx)
+{
+  beginCall(ctx);
+  uint64_t size = ctx->isMounted ? (uint64_t)volumeBlocks(ctx) * JBOD_BLOCK_SIZE : 0;
+  endCall(ctx);
+  return size;
+}
+
+
+
+typedef struct bulk bulk_t;
+
+//one stage of a bulk copy, run on each run of blocks in turn; returns 1 on success and -1 on failure
+typedef int (*bulk_stage_fn)(bulk_t *bulk, uint8_t *data, uint32_t firstBlock, int count);
+
+//a bulk copy between the volume and a file: every run of blocks passes through the stages in order, each stage
+//on a thread of its own, so the JBOD reads of one run overlap with the checksum and file I/O of the ones before it
+struct bulk
+{
+  mdadm_ctx_t *ctx;
+  int fd;
+  //whether fd is open with O_DIRECT
+  bool direct;
+  uint32_t firstBlock;
+  uint32_t numBlocks;
+  int numRuns;
+  bulk_stage_fn stages[BULK_MAX_STAGES];
+  int numStages;
+  //the stage that talks to the volume runs on the calling thread, so its calls keep the caller's tenant
+  int volumeStage;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  //the stage each buffer is waiting for
+  int next[BULK_BUFFERS];
+  bool failed;
+  uint8_t *buffers;
+  uint64_t checksum;
+};
+
+//what a stage thread is given
+typedef struct
+{
+  bulk_t *bulk;
+  int stage;
+} bulk_worker_t;
+
+
+
+//helper method that runs one stage of a bulk copy over every run, in order; a buffer moves on to the next stage
+//when this one is done with it, and back to the first after the last
+static void bulkRunStage(bulk_t *bulk, int stage)
+{
+  for (int seq = 0; seq < bulk->numRuns; seq++)
+  {
+    int slot = seq % BULK_BUFFERS;
+    pthread_mutex_lock(&bulk->lock);
+    while (!bulk->failed && bulk->next[slot] != stage)
+    {
+      pthread_cond_wait(&bulk->cond, &bulk->lock);
+    }
+    bool failed = bulk->failed;
+    pthread_mutex_unlock(&bulk->lock);
+    if (failed)
+    {
+      return;
+    }
+
+    uint32_t done = (uint32_t)seq * BULK_RUN_BLOCKS;
+    int count = (bulk->numBlocks - done < BULK_RUN_BLOCKS) ? (int)(bulk->numBlocks - done) : BULK_RUN_BLOCKS;
+    int rc = bulk->stages[stage](bulk, bulk->buffers + (size_t)slot * BULK_RUN_BLOCKS * JBOD_BLOCK_SIZE,
+                                 bulk->firstBlock + done, count);
+
+    pthread_mutex_lock(&bulk->lock);
+    if (rc == -1)
+    {
+      bulk->failed = true;
+    }
+    bulk->next[slot] = (stage + 1) % bulk->numStages;
+    pthread_cond_broadcast(&bulk->cond);
+    pthread_mutex_unlock(&bulk->lock);
+  }
+}
+
+
+
+static void *bulkWorker(void *arg)
+{
+  bulk_worker_t *worker = arg;
+  bulkRunStage(worker->bulk, worker->stage);
+  return NULL;
+}
+
+
+
+//helper method that runs every stage of bulk, the volume stage on this thread and the others on threads of their own
+static int bulkRun(bulk_t *bulk)
+{
+  pthread_t threads[BULK_MAX_STAGES];
+  bulk_worker_t workers[BULK_MAX_STAGES];
+  bool started[BULK_MAX_STAGES] = { false };
+  pthread_mutex_init(&bulk->lock, NULL);
+  pthread_cond_init(&bulk->cond, NULL);
+  bulk->failed = false;
+  bulk->checksum = FNV_OFFSET_BASIS;
+  for (int i = 0; i < BULK_BUFFERS; i++)
+  {
+    bulk->next[i] = 0;
+  }
+
+  for (int s = 0; s < bulk->numStages; s++)
+  {
+    if (s == bulk->volumeStage)
+    {
+      continue;
+    }
+    workers[s].bulk = bulk;
+    workers[s].stage = s;
+    started[s] = pthread_create(&threads[s], NULL, bulkWorker, &workers[s]) == 0;
+    if (!started[s])
+    {
+      //the stages already running see the failure and stop
+      pthread_mutex_lock(&bulk->lock);
+      bulk->failed = true;
+      pthread_cond_broadcast(&bulk->cond);
+      pthread_mutex_unlock(&bulk->lock);
+      break;
+    }
+  }
+  bulkRunStage(bulk, bulk->volumeStage);
+  for (int s = 0; s < bulk->numStages; s++)
+  {
+    if (started[s])
+    {
+      pthread_join(threads[s], NULL);
+    }
+  }
+  pthread_cond_destroy(&bulk->cond);
+  pthread_mutex_destroy(&bulk->lock);
+  return bulk->failed ? -1 : 1;
+}
+
+
+
+//helper method that turns O_DIRECT off for the last run when it is not a whole number of aligned units
+static int bulkFileLength(bulk_t *bulk, int count)
+{
+  size_t len = (size_t)count * JBOD_BLOCK_SIZE;
+  if (bulk->direct && len % BULK_ALIGN != 0)
+  {
+    int fl = fcntl(bulk->fd, F_GETFL);
+    if (fl == -1 || fcntl(bulk->fd, F_SETFL, fl & ~O_DIRECT) == -1)
+    {
+      return -1;
+    }
+    bulk->direct = false;
+  }
+  return len;
+}
+
+
+
+//stage of mdadm_copy_out that reads a run from the JBOD, as a call of its own
+static int bulkFetch(bulk_t *bulk, uint8_t *data, uint32_t firstBlock, int count)
+{
+  mdadm_ctx_t *ctx = bulk->ctx;
+  traceCall("bulk_fetch", firstBlock * JBOD_BLOCK_SIZE, count * JBOD_BLOCK_SIZE);
+  beginRequest(ctx, requestCost(firstBlock * JBOD_BLOCK_SIZE, count * JBOD_BLOCK_SIZE, false), count * JBOD_BLOCK_SIZE);
+  int rc = -1;
+  //buffered writes have to be on the JBOD before it is read
+  if (ctx->isMounted && firstBlock + count <= volumeBlocks(ctx) &&
+      (ctx->wcUsed == 0 || wcFlush(ctx) == 1))
+  {
+    rc = exportBlocks(ctx, firstBlock, count, data);
+  }
+  endCall(ctx);
+  trace_end();
+  return rc;
+}
+
+
+
+//stage of mdadm_copy_in that writes a run to the volume, as a call of its own
+static int bulkStore(bulk_t *bulk, uint8_t *data, uint32_t firstBlock, int count)
+{
+  mdadm_ctx_t *ctx = bulk->ctx;
+  traceCall("bulk_store", firstBlock * JBOD_BLOCK_SIZE, count * JBOD_BLOCK_SIZE);
+  beginRequest(ctx, requestCost(firstBlock * JBOD_BLOCK_SIZE, count * JBOD_BLOCK_SIZE, true), count * JBOD_BLOCK_SIZE);
+  int rc = -1;
+  if (ctx->isMounted && firstBlock + count <= volumeBlocks(ctx))
+  {
+    if (ctx->cbt != NULL)
+    {
+      cbt_mark(ctx->cbt, firstBlock, count);
+    }
+    //buffered and journaled writes to these blocks are older, so they go out first rather than over the new ones
+    //later; the copy itself is written in place
+    if ((ctx->wcUsed == 0 || wcFlush(ctx) == 1) && jnlDrain(ctx) == 1)
+    {
+      rc = writeBlocks(ctx, firstBlock, count, data);
+    }
+  }
+  endCall(ctx);
+  trace_end();
+  return rc;
+}
+
+
+
+//stage of both copies that hashes the runs in order with FNV-1a
+static int bulkChecksum(bulk_t *bulk, uint8_t *data, uint32_t firstBlock, int count)
+{
+  bulk->checksum = fnv1a(bulk->checksum, data, (size_t)count * JBOD_BLOCK_SIZE);
+  return 1;
+}
+
+
+
+//stage of mdadm_copy_out that writes a run to the file
+static int bulkWriteFile(bulk_t *bulk, uint8_t *data, uint32_t firstBlock, int count)
+{
+  int len = bulkFileLength(bulk, count);
+  off_t offset = (off_t)(firstBlock - bulk->firstBlock) * JBOD_BLOCK_SIZE;
+  int numWritten = 0;
+  //pwrite may write less than asked, so it is called until the whole run is out
+  while (len >= 0 && numWritten < len)
+  {
+    ssize_t n = pwrite(bulk->fd, data + numWritten, len - numWritten, offset + numWritten);
+    if (n <= 0)
+    {
+      return -1;
+    }
+    numWritten += n;
+  }
+  return (len >= 0) ? 1 : -1;
+}
+
+
+
+//stage of mdadm_copy_in that reads a run from the file; a file too short for it is a failure
+static int bulkReadFile(bulk_t *bulk, uint8_t *data, uint32_t firstBlock, int count)
+{
+  int len = bulkFileLength(bulk, count);
+  off_t offset = (off_t)(firstBlock - bulk->firstBlock) * JBOD_BLOCK_SIZE;
+  int numRead = 0;
+  while (len >= 0 && numRead < len)
+  {
+    ssize_t n = pread(bulk->fd, data + numRead, len - numRead, offset + numRead);
+    if (n <= 0)
+    {
+      return -1;
+    }
+    numRead += n;
+  }
+  return (len >= 0) ? 1 : -1;
+}
+
+
+
+//helper method behind mdadm_ctx_copy_out and mdadm_ctx_copy_in: checks the range, opens the file and runs the pipeline
+static int bulkCopy(mdadm_ctx_t *ctx, bool out, const char *path, uint32_t addr, uint32_t len, int flags,
+                    uint64_t *checksum)
+{
+  if (path == NULL || len == 0 || addr % JBOD_BLOCK_SIZE != 0 || len % JBOD_BLOCK_SIZE != 0 ||
+      ((flags & MDADM_COPY_CHECKSUM) && checksum == NULL))
+  {
+    return -1;
+  }
+  //each stage checks the volume again, since it may be unmounted midway
+  if ((uint64_t)addr + len > mdadm_ctx_volume_size(ctx))
+  {
+    return -1;
+  }
+
+  bulk_t bulk = { .ctx = ctx, .firstBlock = addr / JBOD_BLOCK_SIZE, .numBlocks = len / JBOD_BLOCK_SIZE };
+  bulk.numRuns = (bulk.numBlocks + BULK_RUN_BLOCKS - 1) / BULK_RUN_BLOCKS;
+  int openFlags = out ? (O_WRONLY | O_CREAT | O_TRUNC) : O_RDONLY;
+  bulk.direct = (flags & MDADM_COPY_DIRECT) != 0;
+  bulk.fd = open(path, openFlags | (bulk.direct ? O_DIRECT : 0), 0644);
+  //file systems such as tmpfs refuse O_DIRECT, and buffered I/O does instead
+  if (bulk.fd == -1 && bulk.direct && errno == EINVAL)
+  {
+    bulk.direct = false;
+    bulk.fd = open(path, openFlags, 0644);
+  }
+  if (bulk.fd == -1)
+  {
+    return -1;
+  }
+  //O_DIRECT needs aligned buffers
+  if (posix_memalign((void **)&bulk.buffers, BULK_ALIGN, (size_t)BULK_BUFFERS * BULK_RUN_BLOCKS * JBOD_BLOCK_SIZE) != 0)
+  {
+    close(bulk.fd);
+    return -1;
+  }
+
+  //the stages in the order a run goes through them
+  bulk.stages[bulk.numStages++] = out ? bulkFetch : bulkReadFile;
+  if (flags & MDADM_COPY_CHECKSUM)
+  {
+    bulk.stages[bulk.numStages++] = bulkChecksum;
+  }
+  bulk.stages[bulk.numStages++] = out ? bulkWriteFile : bulkStore;
+  bulk.volumeStage = out ? 0 : bulk.numStages - 1;
+
+  trace_begin(out ? "mdadm_copy_out" : "mdadm_copy_in");
+  trace_arg("addr", addr);
+  trace_arg("len", len);
+  int rc = bulkRun(&bulk);
+  trace_end();
+  if (rc == 1 && out && fsync(bulk.fd) == -1)
+  {
+    rc = -1;
+  }
+  if (close(bulk.fd) == -1)
+  {
+    rc = -1;
+  }
+  free(bulk.buffers);
+  if (rc == 1 && (flags & MDADM_COPY_CHECKSUM))
+  {
+    *checksum = bulk.checksum;
+  }
+  return rc;
+}
+
+
+
+int mdadm_ctx_copy_out(mdadm_ctx_t *ctx, uint32_t addr, uint32_t len, const char *path, int flags, uint64_t *checksum)
+{
+  return bulkCopy(ctx, true, path, addr, len, flags, checksum);
+}
+
+
+
+int mdadm_ctx_copy_in(mdadm_ctx_t *ctx, const char *path, uint32_t addr, uint32_t len, int flags, uint64_t *checksum)
+{
+  return bulkCopy(ctx, false, path, addr, len, flags, checksum);
+}
+
+
+
+//helper method that reads count blocks from firstBlock into the cache as a call of its own, for the prefetch thread
+static int prefetchRun(mdadm_ctx_t *ctx, uint32_t firstBlock, int count)
+{
+  traceCall("mdadm_prefetch", firstBlock * JBOD_BLOCK_SIZE, count * JBOD_BLOCK_SIZE);
+  beginRequest(ctx, requestCost(firstBlock * JBOD_BLOCK_SIZE, count * JBOD_BLOCK_SIZE, false), count * JBOD_BLOCK_SIZE);
+  int rc = -1;
+  //an unmount since the advice ends the prefetch
+  if (ctx->isMounted && cache_ctx_enabled(ctx->cache) && !mapped(ctx) &&
+      firstBlock + count <= volumeBlocks(ctx))
+  {
+    rc = fillCache(ctx, firstBlock, count);
+  }
+  endCall(ctx);
+  trace_end();
+  return rc;
+}
+
+
+
+//the prefetch thread: takes WILLNEED ranges off the queue in order and reads them a run at a time
+static void *prefetchMain(void *arg)
+{
+  mdadm_ctx_t *ctx = arg;
+  pthread_mutex_lock(&ctx->prefetchLock);
+  while (!ctx->prefetchStop)
+  {
+    if (ctx->prefetchLen == 0)
+    {
+      pthread_cond_wait(&ctx->prefetchCond, &ctx->prefetchLock);
+      continue;
+    }
+    prefetch_req_t *req = &ctx->prefetchQueue[ctx->prefetchHead];
+    uint32_t firstBlock = req->firstBlock;
+    int count = (req->numBlocks < PREFETCH_RUN_BLOCKS) ? (int)req->numBlocks : PREFETCH_RUN_BLOCKS;
+    //the run is taken off the front of the range before it is read, so an unmount can drop the rest meanwhile
+    req->firstBlock += count;
+    req->numBlocks -= count;
+    if (req->numBlocks == 0)
+    {
+      ctx->prefetchHead = (ctx->prefetchHead + 1) % PREFETCH_QUEUE_LEN;
+      ctx->prefetchLen--;
+    }
+    currentTenant = req->tenant;
+    pthread_mutex_unlock(&ctx->prefetchLock);
+    prefetchRun(ctx, firstBlock, count);
+    pthread_mutex_lock(&ctx->prefetchLock);
+  }
+  pthread_mutex_unlock(&ctx->prefetchLock);
+  return NULL;
+}
+
+
+
+//helper method that queues a WILLNEED range for the prefetch thread, starting it the first time
+static int queuePrefetch(mdadm_ctx_t *ctx, uint32_t firstBlock, uint32_t numBlocks)
+{
+  int rc = 1;
+  pthread_mutex_lock(&ctx->prefetchLock);
+  if (!ctx->prefetchStarted)
+  {
+    ctx->prefetchStarted = pthread_create(&ctx->prefetchThread, NULL, prefetchMain, ctx) == 0;
+  }
+  if (!ctx->prefetchStarted || ctx->prefetchLen == PREFETCH_QUEUE_LEN)
+  {
+    rc = -1;
+  }
+  else
+  {
+    prefetch_req_t *req = &ctx->prefetchQueue[(ctx->prefetchHead + ctx->prefetchLen) % PREFETCH_QUEUE_LEN];
+    req->firstBlock = firstBlock;
+    req->numBlocks = numBlocks;
+    req->tenant = currentTenant;
+    ctx->prefetchLen++;
+    pthread_cond_signal(&ctx->prefetchCond);
+  }
+  pthread_mutex_unlock(&ctx->prefetchLock);
+  return rc;
+}
+
+
+
+//helper method that records standing advice for a range, forgetting older ranges it covers entirely and,
+//when there is no room, the oldest one
+static void addAdvice(mdadm_ctx_t *ctx, uint32_t firstBlock, uint32_t numBlocks, mdadm_advice_t advice)
+{
+  int kept = 0;
+  for (int i = 0; i < ctx->numAdvice; i++)
+  {
+    advice_range_t *range = &ctx->advice[i];
+    bool covered = range->firstBlock >= firstBlock && range->firstBlock + range->numBlocks <= firstBlock + numBlocks;
+    if (!covered)
+    {
+      ctx->advice[kept++] = *range;
+    }
+  }
+  ctx->numAdvice = kept;
+  //NORMAL over nothing but forgotten ranges has nothing left to override
+  if (advice == MDADM_ADVICE_NORMAL && ctx->numAdvice == 0)
+  {
+    return;
+  }
+  if (ctx->numAdvice == ADVICE_MAX_RANGES)
+  {
+    memmove(&ctx->advice[0], &ctx->advice[1], (ADVICE_MAX_RANGES - 1) * sizeof(advice_range_t));
+    ctx->numAdvice--;
+  }
+  ctx->advice[ctx->numAdvice++] = (advice_range_t){ firstBlock, numBlocks, advice };
+}
+
+
+
+int mdadm_ctx_advise(mdadm_ctx_t *ctx, uint32_t addr, uint32_t len, mdadm_advice_t advice)
+{
+  if (advice < MDADM_ADVICE_NORMAL || advice > MDADM_ADVICE_NOREUSE)
+  {
+    return -1;
+  }
+  beginCall(ctx);
+  uint64_t volumeSize = (uint64_t)volumeBlocks(ctx) * JBOD_BLOCK_SIZE;
+  if (!ctx->isMounted || (uint64_t)addr + len > volumeSize)
+  {
+    endCall(ctx);
+    return -1;
+  }
+  if (len == 0)
+  {
+    endCall(ctx);
+    return 1;
+  }
+
+  int rc = 1;
+  uint32_t firstBlock = addr / JBOD_BLOCK_SIZE;
+  uint32_t numBlocks = (addr + len - 1) / JBOD_BLOCK_SIZE - firstBlock + 1;
+  if (advice == MDADM_ADVICE_WILLNEED)
+  {
+    //there is nothing to fill without a cache, or with a mapped backend that needs none
+    if (cache_ctx_enabled(ctx->cache) && !mapped(ctx))
+    {
+      rc = queuePrefetch(ctx, firstBlock, numBlocks);
+    }
+  }
+  else if (advice == MDADM_ADVICE_DONTNEED)
+  {
+    for (uint32_t b = firstBlock; b < firstBlock + numBlocks; b++)
+    {
+      int diskID, blockID;
+      jbod_geometry_locate(&ctx->geometry, b, &diskID, &blockID);
+      cache_ctx_demote(ctx->cache, diskID, blockID);
+    }
+  }
+  else
+  {
+    addAdvice(ctx, firstBlock, numBlocks, advice);
+  }
+  endCall(ctx);
+  return rc;
+}
+
+
+
+int mdadm_set_tenant(int tenant)
+{
+  if (tenant < 0 || tenant >= QOS_MAX_TENANTS)
+  {
+    return -1;
+  }
+  currentTenant = tenant;
+  return 1;
+}
+
+
+
+int mdadm_ctx_set_tenant_limits(mdadm_ctx_t *ctx, int tenant, const mdadm_tenant_limits_t *limits)
+{
+  return (qos_set_tenant(&ctx->qos, tenant, limits) == 0) ? 1 : -1;
+}
+
+
+
+int mdadm_ctx_tenant_stats(mdadm_ctx_t *ctx, int tenant, mdadm_tenant_stats_t *stats)
+{
+  return (qos_stats(&ctx->qos, tenant, stats) == 0) ? 1 : -1;
+}
+
+
+
+void mdadm_ctx_print_tenant_stats(mdadm_ctx_t *ctx)
+{
+  fprintf(stderr, "Tenant  Requests        Bytes         Cost  Throttled  p50(us)  p99(us)  max(us)\n");
+  for (int tenant = 0; tenant < QOS_MAX_TENANTS; tenant++)
+  {
+    qos_stats_t stats;
+    qos_stats(&ctx->qos, tenant, &stats);
+    if (stats.requests == 0)
+    {
+      continue;
+    }
+    fprintf(stderr, "%6d  %8llu %12llu %12llu  %9llu %8llu %8llu %8llu\n", tenant,
+            (unsigned long long)stats.requests, (unsigned long long)stats.bytes, (unsigned long long)stats.cost,
+            (unsigned long long)stats.throttled,
+            (unsigned long long)qos_latency_percentile(&stats, 50) / 1000,
+            (unsigned long long)qos_latency_percentile(&stats, 99) / 1000,
+            (unsigned long long)stats.max_latency_ns / 1000);
+  }
+}
+
+
+
+//helper method that mounts ctx on backend, which stays in use until the next mount
+static int mountOn(mdadm_ctx_t *ctx, jbod_backend_t *backend)
+{
+  trace_begin("mdadm_mount");
+  beginRequest(ctx, QOS_COST_MOUNT, 0);
+  int rc = -1;
+  if (!ctx->isMounted)
+  {
+    //the deadline moves over to the new backend along with everything else
+    jbod_backend_t *previous = ctx->backend;
+    unsigned previousGeneration = ctx->backendGeneration;
+    jbod_geometry_t previousGeometry = ctx->geometry;
+    previous->ops->set_deadline(previous, 0);
+    ctx->backend = backend;
+    ctx->backendGeneration = backend->ops->generation(backend);
+    backend->ops->set_deadline(backend, ctx->deadline);
+    rc = mountLocked(ctx);
+    //a failed mount leaves the context as it was, since the caller may close the backend it just tried
+    if (rc == -1)
+    {
+      backend->ops->set_deadline(backend, 0);
+      ctx->backend = previous;
+      ctx->backendGeneration = previousGeneration;
+      ctx->geometry = previousGeometry;
+      previous->ops->set_deadline(previous, ctx->deadline);
+    }
+  }
+  endCall(ctx);
+  trace_end();
+  return rc;
+}
+
+
+
+int mdadm_ctx_mount(mdadm_ctx_t *ctx)
+{
+  return mountOn(ctx, ctx->ownBackend);
+}
+
+
+
+int mdadm_ctx_mount_backend(mdadm_ctx_t *ctx, jbod_backend_t *backend)
+{
+  if (backend == NULL)
+  {
+    return -1;
+  }
+  return mountOn(ctx, backend);
+}
+
+
+
+int mdadm_ctx_unmount(mdadm_ctx_t *ctx)
+{
+  trace_begin("mdadm_unmount");
+  beginRequest(ctx, QOS_COST_MOUNT, 0);
+  int rc = unmountLocked(ctx);
+  endCall(ctx);
+  trace_end();
+  return rc;
+}
+
+
+
+int mdadm_ctx_read(mdadm_ctx_t *ctx, uint32_t addr, uint32_t len, uint8_t *buf)
+{
+  traceCall("mdadm_read", addr, len);
+  beginRequest(ctx, requestCost(addr, len, false), len);
+  int rc = readLocked(ctx, addr, len, buf);
+  endCall(ctx);
+  trace_end();
+  return rc;
+}
+
+
+
+int mdadm_ctx_read_ref(mdadm_ctx_t *ctx, uint32_t addr, uint32_t len, mdadm_ref_t *refs, int max_refs)
+{
+  traceCall("mdadm_read_ref", addr, len);
+  beginRequest(ctx, requestCost(addr, len, false), len);
+  int rc = readRefLocked(ctx, addr, len, refs, max_refs);
+  endCall(ctx);
+  trace_end();
+  return rc;
+}
+
+
+
+void mdadm_ctx_release_ref(mdadm_ctx_t *ctx, mdadm_ref_t *refs, int num_refs)
+{
+  if (refs == NULL || num_refs <= 0)
+  {
+    return;
+  }
+  //the cache is not locked on its own, so unpinning waits for any call in progress
+  pthread_mutex_lock(&ctx->lock);
+  releaseRefs(ctx, refs, num_refs);
+  pthread_mutex_unlock(&ctx->lock);
+}
+
+
+
+int mdadm_ctx_write(mdadm_ctx_t *ctx, uint32_t addr, uint32_t len, const uint8_t *buf)
+{
+  traceCall("mdadm_write", addr, len);
+  //counted while queued, so the leader of a group commit knows to wait for this write
+  atomic_fetch_add(&ctx->writersWaiting, 1);
+  beginRequest(ctx, requestCost(addr, len, true), len);
+  atomic_fetch_sub(&ctx->writersWaiting, 1);
+  int rc = writeLocked(ctx, addr, len, buf);
+  endCall(ctx);
+  trace_end();
+  return rc;
+}
+
+
+
+int mdadm_mount(void) 
+{
+  return mdadm_ctx_mount(mdadm_default_ctx());
+}
+
+
+
+int mdadm_mount_backend(jbod_backend_t *backend)
+{
+  return mdadm_ctx_mount_backend(mdadm_default_ctx(), backend);
+}
+
+
+
+int mdadm_unmount(void) 
+{
+  return mdadm_ctx_unmount(mdadm_default_ctx());
+}
+
+
+
+int mdadm_read(uint32_t addr, uint32_t len, uint8_t *buf) 
+{
+  return mdadm_ctx_read(mdadm_default_ctx(), addr, len, buf);
+}
+
+
+
+int mdadm_read_ref(uint32_t addr, uint32_t len, mdadm_ref_t *refs, int max_refs) 
+{
+  return mdadm_ctx_read_ref(mdadm_default_ctx(), addr, len, refs, max_refs);
+}
+
+
+
+void mdadm_release_ref(mdadm_ref_t *refs, int num_refs) 
+{
+  mdadm_ctx_release_ref(mdadm_default_ctx(), refs, num_refs);
+}
+
+
+
+int mdadm_write(uint32_t addr, uint32_t len, const uint8_t *buf) 
+{
+  return mdadm_ctx_write(mdadm_default_ctx(), addr, len, buf);
+}
+
+
+
+int mdadm_set_timeout(int timeout_ms) 
+{
+  return mdadm_ctx_set_timeout(mdadm_default_ctx(), timeout_ms);
+}
+
+
+
+int mdadm_set_write_combining(int max_blocks, int window_ms) 
+{
+  return mdadm_ctx_set_write_combining(mdadm_default_ctx(), max_blocks, window_ms);
+}
+
+
+
+int mdadm_flush(void) 
+{
+  return mdadm_ctx_flush(mdadm_default_ctx());
+}
+
+
+
+int mdadm_set_change_tracking(const char *path) 
+{
+  return mdadm_ctx_set_change_tracking(mdadm_default_ctx(), path);
+}
+
+
+
+int mdadm_set_journal(int num_blocks) 
+{
+  return mdadm_ctx_set_journal(mdadm_default_ctx(), num_blocks);
+}
+
+
+
+int mdadm_begin_epoch(uint32_t *epoch) 
+{
+  return mdadm_ctx_begin_epoch(mdadm_default_ctx(), epoch);
+}
+
+
+
+int mdadm_export_changes(uint32_t since, mdadm_export_fn fn, void *arg) 
+{
+  return mdadm_ctx_export_changes(mdadm_default_ctx(), since, fn, arg);
+}
+
+
+
+int mdadm_advise(uint32_t addr, uint32_t len, mdadm_advice_t advice) 
+{
+  return mdadm_ctx_advise(mdadm_default_ctx(), addr, len, advice);
+}
+
+
+
+uint64_t mdadm_volume_size(void) 
+{
+  return mdadm_ctx_volume_size(mdadm_default_ctx());
+}
+
+
+
+int mdadm_copy_out(uint32_t addr, uint32_t len, const char *path, int flags, uint64_t *checksum) 
+{
+  return mdadm_ctx_copy_out(mdadm_default_ctx(), addr, len, path, flags, checksum);
+}
+
+
+
+int mdadm_copy_in(const char *path, uint32_t addr, uint32_t len, int flags, uint64_t *checksum) 
+{
+  return mdadm_ctx_copy_in(mdadm_default_ctx(), path, addr, len, flags, checksum);
+}
+
+
+
+int mdadm_set_tenant_limits(int tenant, const mdadm_tenant_limits_t *limits) 
+{
+  return mdadm_ctx_set_tenant_limits(mdadm_default_ctx(), tenant, limits);
+}
+
+
+
+int mdadm_tenant_stats(int tenant, mdadm_tenant_stats_t *stats) 
+{
+  return mdadm_ctx_tenant_stats(mdadm_default_ctx(), tenant, stats);
+}
+
+
+
+void mdadm_print_tenant_stats(void) 
+{
+  mdadm_ctx_print_tenant_stats(mdadm_default_ctx());
+}
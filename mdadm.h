@@ -3,17 +3,234 @@
 
 #include <stdint.h>
 #include "jbod.h"
+#include "backend.h"
+#include "qos.h"
+
+/* A handle on one mounted volume. Each context owns its connection, mount
+ * and seek state and cache, so separate contexts may be used from separate
+ * threads; calls on the same context are serialized internally. */
+typedef struct mdadm_ctx mdadm_ctx_t;
 
 /* Return 1 on success and -1 on failure */
 int mdadm_mount(void);
 
+/* Return 1 on success and -1 on failure. Mounts the volume on |backend|
+ * (see backend.h) rather than the JBOD server set up by jbod_connect; it
+ * stays in use until the next mount, and a failed mount keeps the one in
+ * use before. The caller keeps ownership of the backend and closes it once
+ * the volume is unmounted. A backend whose blocks are mapped into memory is
+ * read in place and bypasses the cache. */
+int mdadm_mount_backend(jbod_backend_t *backend);
+
 /* Return 1 on success and -1 on failure */
 int mdadm_unmount(void);
 
 /* Return the number of bytes read on success, -1 on failure. */
 int mdadm_read(uint32_t addr, uint32_t len, uint8_t *buf);
 
+/* A read-only view of the part of one block a read covers, see mdadm_read_ref. */
+typedef struct {
+  const uint8_t *data;
+  uint32_t len;
+  /* what mdadm_release_ref gives back: a pinned cache block, or a private copy */
+  const uint8_t *pinned;
+  uint8_t *copy;
+} mdadm_ref_t;
+
+/* Return the number of references filled in, -1 on failure. Reads like
+ * mdadm_read, but instead of copying into a buffer fills in one reference
+ * per block the range touches (at most |max_refs|; 5 covers any read), in
+ * address order, whose data and len together make up the range. Cache hits
+ * point into the cache's own storage, pinned so they are neither reused nor
+ * changed until released; later writes to those blocks go to fresh storage.
+ * Blocks of a mapped backend point into the mapping. Misses, and hits in a
+ * shared cache, get a private copy. Buffered writes are flushed first. */
+int mdadm_read_ref(uint32_t addr, uint32_t len, mdadm_ref_t *refs, int max_refs);
+
+/* Releases |num_refs| references filled in by mdadm_read_ref. Every one has
+ * to be released before the cache is destroyed or the volume unmounted. */
+void mdadm_release_ref(mdadm_ref_t *refs, int num_refs);
+
 /* Return the number of bytes written on success, -1 on failure. */
 int mdadm_write(uint32_t addr, uint32_t len, const uint8_t *buf);
 
+/* Return 1 on success and -1 on failure. Bounds every later mount, unmount,
+ * read and write to |timeout_ms| milliseconds, including time spent waiting
+ * for other callers of the same context; 0 removes the limit. A call that
+ * runs out of time fails with -1, and the connection is re-established on
+ * the next call. */
+int mdadm_set_timeout(int timeout_ms);
+
+/* Return 1 on success and -1 on failure. Turns on write combining: writes
+ * are gathered in a buffer of up to |max_blocks| blocks (at most 32), where
+ * adjacent and overlapping writes merge into whole block images, and reach
+ * the JBOD together as one write per block. The buffer is flushed when it is
+ * full, on the first call after it has held data for |window_ms|
+ * milliseconds, on mdadm_flush and on unmount. Reads see buffered data.
+ * |max_blocks| of 0 turns write combining off again. */
+int mdadm_set_write_combining(int max_blocks, int window_ms);
+
+/* Return 1 on success and -1 on failure. Writes out anything held by the
+ * write-combining buffer, then asks the backend to make the writes durable. */
+int mdadm_flush(void);
+
+/* Return 1 on success and -1 on failure. Turns on changed-block tracking:
+ * while mounted, every write marks the blocks it touches in a bitmap for the
+ * current backup epoch, kept in the file at |path| (see cbt.h) so it
+ * survives restarts. The file is opened at mount and written out on
+ * mdadm_flush and unmount; a mount fails if it cannot be opened. NULL turns
+ * tracking off again. */
+int mdadm_set_change_tracking(const char *path);
+
+/* Return 1 on success and -1 on failure. From the next mount on, reserves
+ * the last |num_blocks| blocks of the volume (at least 60; 0 for none) for a
+ * write-ahead journal, and the volume callers see shrinks by as much. Every
+ * write, and every write-combining flush, then goes into the journal as one
+ * record, which a crash leaves either wholly applied or not at all, and is
+ * acknowledged once the record is durable. Writes from callers queued up
+ * behind one another are gathered into one record and one JBOD write (group
+ * commit). Journaled blocks reach their place in the volume, in disk/block
+ * order, when the journal fills up, on unmount and before mdadm_copy_in; a
+ * mount replays whatever a crash left in the journal, so the size has to
+ * stay the same until then. A journaled volume is only consistent for the
+ * one process that has it mounted. */
+int mdadm_set_journal(int num_blocks);
+
+/* Return 1 on success and -1 on failure. Starts a new backup epoch and
+ * stores its number in |epoch|. Blocks written from now on are changed
+ * since |epoch|; the last 8 epochs are remembered. Needs tracking on and the
+ * volume mounted. */
+int mdadm_begin_epoch(uint32_t *epoch);
+
+/* Called by mdadm_export_changes with |len| bytes of the volume starting at
+ * |addr|, always whole blocks. Returns -1 to stop the export. It runs with
+ * the context locked and must not call back into it. */
+typedef int (*mdadm_export_fn)(void *arg, uint32_t addr, uint32_t len, const uint8_t *data);
+
+/* Returns the number of blocks exported, or -1 on failure. Hands every block
+ * written since the start of epoch |since| to |fn|, in runs of up to 64
+ * blocks and in address order, so the JBOD reads them with forward seeks
+ * only. The reads bypass the cache. Fails when |since| is older than the
+ * epochs remembered, in which case a full backup is needed. An incremental
+ * backup is: epoch = mdadm_begin_epoch(), then export since the previous
+ * backup's epoch. */
+int mdadm_export_changes(uint32_t since, mdadm_export_fn fn, void *arg);
+
+/* The size of the mounted volume in bytes, 0 when it is not mounted. */
+uint64_t mdadm_volume_size(void);
+
+/* options of mdadm_copy_out and mdadm_copy_in */
+#define MDADM_COPY_CHECKSUM 0x1  /* checksum the bytes copied, see below */
+#define MDADM_COPY_DIRECT 0x2    /* file I/O with O_DIRECT, where the file system allows it */
+
+/* Return 1 on success and -1 on failure. Copies |len| bytes of the volume
+ * starting at |addr|, both whole blocks, to the file at |path|, which is
+ * created or truncated and synced at the end. The copy is a pipeline: the
+ * JBOD reads of one run of blocks, the checksum of the run before it and the
+ * file write of the one before that overlap, with a few runs in flight. The
+ * reads go straight to the JBOD in address order, and each run is a call of
+ * its own, so other callers are not held off for the whole copy (and may
+ * change blocks not yet copied). With MDADM_COPY_CHECKSUM, |checksum| gets
+ * the 64-bit FNV-1a hash of the bytes copied. */
+int mdadm_copy_out(uint32_t addr, uint32_t len, const char *path, int flags, uint64_t *checksum);
+
+/* Return 1 on success and -1 on failure. The reverse of mdadm_copy_out:
+ * writes the first |len| bytes of the file at |path| to the volume starting
+ * at |addr|, keeping the cache and change tracking up to date. */
+int mdadm_copy_in(const char *path, uint32_t addr, uint32_t len, int flags, uint64_t *checksum);
+
+/* What the application expects of a range of the volume, see mdadm_advise. */
+typedef enum {
+  MDADM_ADVICE_NORMAL,      /* nothing in particular; clears earlier advice */
+  MDADM_ADVICE_SEQUENTIAL,  /* read in address order, once */
+  MDADM_ADVICE_RANDOM,      /* read in no particular order */
+  MDADM_ADVICE_WILLNEED,    /* about to be read */
+  MDADM_ADVICE_DONTNEED,    /* not going to be read again soon */
+  MDADM_ADVICE_NOREUSE,     /* read or written once */
+} mdadm_advice_t;
+
+/* Return 1 on success and -1 on failure. Tells the cache and read path what
+ * to expect of the |len| bytes at |addr| (any length, rounded out to whole
+ * blocks) of the mounted volume:
+ *  - SEQUENTIAL reads ahead of each read, in one JBOD call per batch of
+ *    blocks, and moves the blocks a read has finished with to the cold end
+ *    of the cache, so a scan hits the cache without crowding it out.
+ *  - RANDOM and NORMAL read only what is asked for, which is the default.
+ *  - NOREUSE keeps blocks read or written out of the cache; blocks already
+ *    cached stay up to date.
+ *  - WILLNEED queues the range for a background thread that reads its
+ *    uncached blocks into the cache, a run at a time between other calls.
+ *  - DONTNEED moves the range's cached blocks to the cold end of the cache.
+ * NORMAL, SEQUENTIAL, RANDOM and NOREUSE stay in force for the range until
+ * unmount or later advice for it; WILLNEED and DONTNEED act once. */
+int mdadm_advise(uint32_t addr, uint32_t len, mdadm_advice_t advice);
+
+/* Return 1 on success and -1 on failure. Tags every later call made by this
+ * thread with |tenant| (0 to 15; 0 until set), on any context. */
+int mdadm_set_tenant(int tenant);
+
+/* The weight and rate limits of a tenant, see qos.h. */
+typedef qos_limits_t mdadm_tenant_limits_t;
+
+/* Return 1 on success and -1 on failure. Configures |tenant| and turns on
+ * the QoS scheduler: while calls wait for the volume, the next one is
+ * picked by weighted fair queuing on estimated JBOD cost, and a tenant over
+ * its token-bucket limits (JBOD cost units and bytes per second) waits while
+ * others go ahead. Tenants left unconfigured get weight 1 and no limits. */
+int mdadm_set_tenant_limits(int tenant, const mdadm_tenant_limits_t *limits);
+
+/* Requests, bytes, estimated cost, throttling and a latency histogram
+ * (queueing included) of one tenant, counted once the scheduler is on. */
+typedef qos_stats_t mdadm_tenant_stats_t;
+
+/* Return 1 on success and -1 on failure. */
+int mdadm_tenant_stats(int tenant, mdadm_tenant_stats_t *stats);
+
+/* Prints the statistics of every tenant that made a call, with p50 and p99
+ * latencies. */
+void mdadm_print_tenant_stats(void);
+
+/* Returns the context used by the functions above. It talks over the
+ * connection set up by jbod_connect and uses the cache set up by
+ * cache_create. */
+mdadm_ctx_t *mdadm_default_ctx(void);
+
+/* Returns a new context with its own connection to the JBOD server at
+ * |ip|:|port| and a private cache of |cache_entries| entries (0 disables
+ * caching), or NULL on failure. */
+mdadm_ctx_t *mdadm_open(const char *ip, uint16_t port, int cache_entries);
+
+/* Same as mdadm_open, but the cache is the shared memory segment
+ * |cache_name| (see cache_create_shared), shared with every process that
+ * opens a context with the same name. A write invalidates the blocks it
+ * touches for all of them. */
+mdadm_ctx_t *mdadm_open_shared(const char *ip, uint16_t port, const char *cache_name, int cache_entries);
+
+/* Return 1 on success and -1 on failure. Unmounts the volume if it is still
+ * mounted, then releases the connection and cache of |ctx|. */
+int mdadm_close(mdadm_ctx_t *ctx);
+
+/* Same as the functions above, on an explicit context. */
+int mdadm_ctx_mount(mdadm_ctx_t *ctx);
+int mdadm_ctx_mount_backend(mdadm_ctx_t *ctx, jbod_backend_t *backend);
+int mdadm_ctx_unmount(mdadm_ctx_t *ctx);
+int mdadm_ctx_read(mdadm_ctx_t *ctx, uint32_t addr, uint32_t len, uint8_t *buf);
+int mdadm_ctx_write(mdadm_ctx_t *ctx, uint32_t addr, uint32_t len, const uint8_t *buf);
+int mdadm_ctx_read_ref(mdadm_ctx_t *ctx, uint32_t addr, uint32_t len, mdadm_ref_t *refs, int max_refs);
+void mdadm_ctx_release_ref(mdadm_ctx_t *ctx, mdadm_ref_t *refs, int num_refs);
+int mdadm_ctx_set_timeout(mdadm_ctx_t *ctx, int timeout_ms);
+int mdadm_ctx_set_write_combining(mdadm_ctx_t *ctx, int max_blocks, int window_ms);
+int mdadm_ctx_flush(mdadm_ctx_t *ctx);
+int mdadm_ctx_set_change_tracking(mdadm_ctx_t *ctx, const char *path);
+int mdadm_ctx_set_journal(mdadm_ctx_t *ctx, int num_blocks);
+int mdadm_ctx_begin_epoch(mdadm_ctx_t *ctx, uint32_t *epoch);
+int mdadm_ctx_export_changes(mdadm_ctx_t *ctx, uint32_t since, mdadm_export_fn fn, void *arg);
+uint64_t mdadm_ctx_volume_size(mdadm_ctx_t *ctx);
+int mdadm_ctx_copy_out(mdadm_ctx_t *ctx, uint32_t addr, uint32_t len, const char *path, int flags, uint64_t *checksum);
+int mdadm_ctx_copy_in(mdadm_ctx_t *ctx, const char *path, uint32_t addr, uint32_t len, int flags, uint64_t *checksum);
+int mdadm_ctx_advise(mdadm_ctx_t *ctx, uint32_t addr, uint32_t len, mdadm_advice_t advice);
+int mdadm_ctx_set_tenant_limits(mdadm_ctx_t *ctx, int tenant, const mdadm_tenant_limits_t *limits);
+int mdadm_ctx_tenant_stats(mdadm_ctx_t *ctx, int tenant, mdadm_tenant_stats_t *stats);
+void mdadm_ctx_print_tenant_stats(mdadm_ctx_t *ctx);
+
 #endif
@@ -0,0 +1,66 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "mrc.h"
+#include "util.h"
+
+void mrc_reset(mrc_t *m) {
+  memset(m, 0, sizeof(*m));
+}
+
+static bool sampled(uint64_t key) {
+  return (mix64(key) & ((1 << MRC_SAMPLE_SHIFT) - 1)) == 0;
+}
+
+void mrc_access(mrc_t *m, int disk_num, int block_num) {
+  uint64_t key = ((uint64_t)disk_num << 32) | (uint32_t)block_num;
+
+  m->references++;
+  if (!sampled(key))
+    return;
+  m->sampled++;
+
+  /* the position in the stack is the number of distinct tracked blocks
+   * accessed since the last access to this one */
+  int pos = 0;
+  while (pos < m->depth && m->stack[pos] != key)
+    pos++;
+
+  if (pos == m->depth) {
+    m->cold++;
+    if (m->depth < MRC_STACK_DEPTH)
+      m->depth++;
+    else
+      pos--;  /* the deepest block falls off */
+  } else {
+    m->histogram[pos << MRC_SAMPLE_SHIFT]++;
+  }
+
+  memmove(&m->stack[1], &m->stack[0], pos * sizeof(m->stack[0]));
+  m->stack[0] = key;
+}
+
+void mrc_estimate(const mrc_t *m, mrc_point_t *points, int num_points) {
+  /* the share of accesses that hit tracked blocks drifts from the sampling
+   * rate; count the difference as reuses at distance zero (SHARDS-adj) */
+  double expected = (double)m->references / (1 << MRC_SAMPLE_SHIFT);
+  double adjust = expected - (double)m->sampled;
+
+  for (int i = 0; i < num_points; ++i) {
+    mrc_point_t *p = &points[i];
+    p->hit_rate = 0;
+    p->cost_saved = 0;
+    if (expected <= 0 || p->entries <= 0)
+      continue;
+
+    double hits = adjust;
+    for (int d = 0; d < p->entries && d < MRC_MAX_DISTANCE; ++d)
+      hits += m->histogram[d];
+    p->hit_rate = hits / expected;
+    if (p->hit_rate < 0)
+      p->hit_rate = 0;
+    if (p->hit_rate > 1)
+      p->hit_rate = 1;
+    p->cost_saved = (uint64_t)(p->hit_rate * m->references) * MRC_BLOCK_READ_COST;
+  }
+}
@@ -0,0 +1,53 @@
+#ifndef MRC_H_
+#define MRC_H_
+
+#include <stdint.h>
+
+
+/* Online miss ratio curve estimation (SHARDS). A fixed fraction of the
+ * blocks, chosen by hashing their address, is tracked in an LRU stack; the
+ * reuse distance of each access to a tracked block, scaled up by the sampling
+ * rate, goes into a histogram. The hit rate of an LRU cache of any size is the
+ * share of accesses whose reuse distance is smaller than the size. */
+
+/* the largest cache size estimated for, that of the largest cache */
+#define MRC_MAX_DISTANCE 4096
+
+/* one block in 2^MRC_SAMPLE_SHIFT is tracked. The address space is small,
+ * so a few very hot blocks weigh heavily; sparser sampling than this skews
+ * the estimates on skewed workloads. */
+#define MRC_SAMPLE_SHIFT 2
+
+/* tracked blocks further down the stack than this are beyond every cache
+ * size, so they are dropped and their next access counts as a first one */
+#define MRC_STACK_DEPTH (MRC_MAX_DISTANCE >> MRC_SAMPLE_SHIFT)
+
+/* what a hit saves: the JBOD's charge for reading a block */
+#define MRC_BLOCK_READ_COST 100
+
+typedef struct {
+  uint64_t references;          /* all accesses, sampled or not */
+  uint64_t sampled;             /* accesses to tracked blocks */
+  uint64_t cold;                /* first accesses to tracked blocks */
+  int depth;                    /* tracked blocks on the stack */
+  uint64_t stack[MRC_STACK_DEPTH];  /* tracked blocks, most recently used first */
+  uint32_t histogram[MRC_MAX_DISTANCE];  /* accesses by scaled reuse distance */
+} mrc_t;
+
+/* an estimate for one cache size */
+typedef struct {
+  int entries;
+  double hit_rate;
+  uint64_t cost_saved;  /* over all accesses so far */
+} mrc_point_t;
+
+void mrc_reset(mrc_t *m);
+
+/* Records an access to |disk_num|, |block_num|. */
+void mrc_access(mrc_t *m, int disk_num, int block_num);
+
+/* Fills in hit_rate and cost_saved for the entries of each of the
+ * |num_points| points. */
+void mrc_estimate(const mrc_t *m, mrc_point_t *points, int num_points);
+
+#endif
@@ -4,12 +4,108 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "geometry.h"
+
 #define HEADER_LEN (sizeof(uint16_t) + sizeof(uint32_t) + sizeof(uint16_t))
 #define JBOD_SERVER "127.0.0.1"
 #define JBOD_PORT 3333
 
+/* Protocol v2 adds commands past the JBOD's own, in the same 6-bit command
+ * field. A client opens with JBOD_CMD_HELLO carrying the highest version it
+ * speaks in the low 8 bits of the op; a v2 server answers with the version it
+ * agrees to in the same bits, a v1 server rejects the unknown command.
+ *
+ * The extent commands fuse the seeks into the transfer: the disk and block
+ * fields of the op give the first block and the low 8 bits give the number of
+ * blocks, which must not run past the end of the disk. The blocks travel as
+ * the payload of the request (write) or the response (read), and the JBOD is
+ * left just past the last block.
+ *
+ * Protocol v3 lets the array be larger than the op fields can address.
+ * JBOD_CMD_GEOMETRY returns the number of disks, blocks per disk and block
+ * size as three 32-bit big-endian integers, which the client asks for at
+ * mount time. The wide extent commands work like the v2 ones, except that
+ * the disk and block travel as two 32-bit big-endian integers at the start
+ * of the request payload (JBOD_EXTENT_ADDR_LEN bytes, ahead of the blocks of
+ * a write). Disk and block numbers in extent commands, narrow or wide, are in
+ * the server's geometry. */
+#define JBOD_PROTO_V1 1
+#define JBOD_PROTO_V2 2
+#define JBOD_PROTO_V3 3
+#define JBOD_PROTO_VERSION JBOD_PROTO_V3
+
+#define JBOD_CMD_HELLO 0x20
+#define JBOD_CMD_READ_EXTENT 0x21
+#define JBOD_CMD_WRITE_EXTENT 0x22
+/* payload: the NUL-terminated name of a shared memory ring, see ring.h */
+#define JBOD_CMD_ATTACH_RING 0x23
+#define JBOD_CMD_GEOMETRY 0x24
+#define JBOD_CMD_READ_EXTENT_WIDE 0x25
+#define JBOD_CMD_WRITE_EXTENT_WIDE 0x26
+
+/* the packet length field is 16 bits, which bounds an extent */
+#define JBOD_MAX_EXTENT_BLOCKS 255
+#define JBOD_EXTENT_ADDR_LEN (2 * sizeof(uint32_t))
+#define JBOD_GEOMETRY_LEN (3 * sizeof(uint32_t))
+/* the largest payload a packet carries, a wide extent write */
+#define JBOD_MAX_PAYLOAD (JBOD_EXTENT_ADDR_LEN + JBOD_MAX_EXTENT_BLOCKS * JBOD_BLOCK_SIZE)
+
+/* how requests travel once a connection is open. The shared memory ring only
+ * works with a v2 server on the same host; when the server cannot attach it
+ * the connection falls back to TCP. */
+typedef enum {
+  JBOD_TRANSPORT_TCP,
+  JBOD_TRANSPORT_SHM,
+} jbod_transport_t;
+
+struct jbod_ring;
+
+/* one client connection to a JBOD server. A connection carries a single
+ * request/response exchange at a time, so its owner serializes access.
+ *
+ * Every request is bounded by the sooner of the per-request timeout and the
+ * caller's deadline. A request that fails midway (timeout, reset, short read)
+ * leaves the connection broken; the next request first re-establishes it,
+ * with a bounded number of attempts and exponential backoff, and bumps
+ * |generation| so callers know the server's seek position was lost. */
+typedef struct jbod_conn {
+  int sd;
+  int version;  /* protocol version agreed with the server */
+  struct jbod_ring *ring;  /* set when requests go through shared memory */
+  char ip[16];
+  uint16_t port;
+  jbod_transport_t transport;
+  int timeout_ms;  /* per-request timeout, 0 for none */
+  int64_t deadline_ns;  /* absolute CLOCK_MONOTONIC deadline, 0 for none */
+  bool broken;
+  unsigned generation;
+} jbod_conn_t;
+
 int jbod_client_operation(uint32_t op, uint8_t *block);
 bool jbod_connect(const char *ip, uint16_t port);
 void jbod_disconnect(void);
+bool jbod_connect_transport(const char *ip, uint16_t port, jbod_transport_t transport);
+
+/* returns the connection used by the functions above */
+jbod_conn_t *jbod_default_conn(void);
+
+/* same as above, on an explicit connection */
+bool jbod_conn_open(jbod_conn_t *conn, const char *ip, uint16_t port);
+bool jbod_conn_open_transport(jbod_conn_t *conn, const char *ip, uint16_t port, jbod_transport_t transport);
+void jbod_conn_close(jbod_conn_t *conn);
+int jbod_conn_operation(jbod_conn_t *conn, uint32_t op, uint8_t *block);
+void jbod_conn_set_timeout(jbod_conn_t *conn, int timeout_ms);
+void jbod_conn_set_deadline(jbod_conn_t *conn, int64_t deadline_ns);
+
+/* protocol v2 only: move |count| blocks starting at |disk|/|block| in a
+ * single exchange. Return 0 on success and -1 on failure, including when the
+ * server only speaks v1. Addresses beyond the op fields use the wide
+ * commands, which need a v3 server. */
+int jbod_conn_read_extent(jbod_conn_t *conn, int disk, int block, int count, uint8_t *buf);
+int jbod_conn_write_extent(jbod_conn_t *conn, int disk, int block, int count, const uint8_t *buf);
+
+/* Returns 0 on success and -1 on failure. Fills in |geometry| with the
+ * server's array; servers older than v3 have the one in jbod.h. */
+int jbod_conn_geometry(jbod_conn_t *conn, jbod_geometry_t *geometry);
 
 #endif
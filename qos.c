@@ -0,0 +1,202 @@
+#include <string.h>
+#include <time.h>
+
+#include "qos.h"
+#include "util.h"
+
+struct qos_waiter {
+  int tenant;
+  double start;
+  double finish;
+  qos_waiter_t *next;
+};
+
+void qos_init(qos_t *q)
+{
+  memset(q, 0, sizeof(*q));
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->cond, NULL);
+}
+
+void qos_destroy(qos_t *q)
+{
+  pthread_cond_destroy(&q->cond);
+  pthread_mutex_destroy(&q->lock);
+}
+
+static double burst(uint64_t burst, uint64_t rate)
+{
+  return burst ? burst : rate;
+}
+
+static void refill(qos_tenant_t *t, int64_t now)
+{
+  double dt = (now - t->refilled_ns) / 1e9;
+  t->refilled_ns = now;
+  if (t->limits.cost_per_sec) {
+    t->cost_tokens += dt * t->limits.cost_per_sec;
+    if (t->cost_tokens > burst(t->limits.cost_burst, t->limits.cost_per_sec))
+      t->cost_tokens = burst(t->limits.cost_burst, t->limits.cost_per_sec);
+  }
+  if (t->limits.bytes_per_sec) {
+    t->byte_tokens += dt * t->limits.bytes_per_sec;
+    if (t->byte_tokens > burst(t->limits.bytes_burst, t->limits.bytes_per_sec))
+      t->byte_tokens = burst(t->limits.bytes_burst, t->limits.bytes_per_sec);
+  }
+}
+
+/* a request is let through on any positive balance and may leave the bucket in debt */
+static bool eligible(const qos_tenant_t *t)
+{
+  return (!t->limits.cost_per_sec || t->cost_tokens >= 0) && (!t->limits.bytes_per_sec || t->byte_tokens >= 0);
+}
+
+/* when the tenant's debts will have been paid off */
+static int64_t eligible_at(const qos_tenant_t *t, int64_t now)
+{
+  double wait = 0;
+  if (t->limits.cost_per_sec && t->cost_tokens < 0 && -t->cost_tokens / t->limits.cost_per_sec > wait)
+    wait = -t->cost_tokens / t->limits.cost_per_sec;
+  if (t->limits.bytes_per_sec && t->byte_tokens < 0 && -t->byte_tokens / t->limits.bytes_per_sec > wait)
+    wait = -t->byte_tokens / t->limits.bytes_per_sec;
+  return now + (int64_t)(wait * 1e9) + 1;
+}
+
+/* the waiter with the smallest finish tag among the tenants that have tokens */
+static qos_waiter_t *next_waiter(qos_t *q, int64_t now)
+{
+  qos_waiter_t *best = NULL;
+  for (qos_waiter_t *w = q->waiters; w; w = w->next) {
+    qos_tenant_t *t = &q->tenants[w->tenant];
+    refill(t, now);
+    if (eligible(t) && (!best || w->finish < best->finish))
+      best = w;
+  }
+  return best;
+}
+
+static void wait_until(qos_t *q, int64_t deadline_ns)
+{
+  /* the condition variable keeps CLOCK_REALTIME, so the deadline is moved over */
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  int64_t abs = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec + (deadline_ns - monotonic_ns());
+  ts.tv_sec = abs / 1000000000;
+  ts.tv_nsec = abs % 1000000000;
+  pthread_cond_timedwait(&q->cond, &q->lock, &ts);
+}
+
+int qos_set_tenant(qos_t *q, int tenant, const qos_limits_t *limits)
+{
+  if (tenant < 0 || tenant >= QOS_MAX_TENANTS || !limits)
+    return -1;
+  pthread_mutex_lock(&q->lock);
+  qos_tenant_t *t = &q->tenants[tenant];
+  t->limits = *limits;
+  t->cost_tokens = burst(limits->cost_burst, limits->cost_per_sec);
+  t->byte_tokens = burst(limits->bytes_burst, limits->bytes_per_sec);
+  t->refilled_ns = monotonic_ns();
+  q->enabled = true;
+  /* waiters held back by the old limits look again */
+  pthread_cond_broadcast(&q->cond);
+  pthread_mutex_unlock(&q->lock);
+  return 0;
+}
+
+void qos_acquire(qos_t *q, qos_ticket_t *ticket)
+{
+  pthread_mutex_lock(&q->lock);
+  ticket->scheduled = q->enabled && ticket->tenant >= 0 && ticket->tenant < QOS_MAX_TENANTS;
+  if (!ticket->scheduled) {
+    pthread_mutex_unlock(&q->lock);
+    return;
+  }
+  int64_t now = monotonic_ns();
+  ticket->arrival_ns = now;
+
+  qos_tenant_t *t = &q->tenants[ticket->tenant];
+  qos_waiter_t w = { .tenant = ticket->tenant };
+  w.start = (t->finish > q->vtime) ? t->finish : q->vtime;
+  w.finish = w.start + (double)(ticket->cost ? ticket->cost : 1) / (t->limits.weight ? t->limits.weight : 1);
+  t->finish = w.finish;
+  w.next = q->waiters;
+  q->waiters = &w;
+
+  bool throttled = false;
+  for (;;) {
+    qos_waiter_t *next = next_waiter(q, now);
+    if (!q->busy && next == &w)
+      break;
+    /* the resource is free but someone else's turn; make sure they know */
+    if (!q->busy && next)
+      pthread_cond_broadcast(&q->cond);
+    if (!eligible(t)) {
+      throttled = true;
+      wait_until(q, eligible_at(t, now));
+    } else {
+      pthread_cond_wait(&q->cond, &q->lock);
+    }
+    now = monotonic_ns();
+  }
+
+  qos_waiter_t **link = &q->waiters;
+  while (*link != &w)
+    link = &(*link)->next;
+  *link = w.next;
+  q->busy = true;
+  q->vtime = w.start;
+
+  if (t->limits.cost_per_sec)
+    t->cost_tokens -= ticket->cost;
+  if (t->limits.bytes_per_sec)
+    t->byte_tokens -= ticket->bytes;
+  if (throttled) {
+    t->stats.throttled++;
+    t->stats.throttled_ns += now - ticket->arrival_ns;
+  }
+  pthread_mutex_unlock(&q->lock);
+}
+
+void qos_release(qos_t *q, const qos_ticket_t *ticket)
+{
+  if (!ticket->scheduled)
+    return;
+  pthread_mutex_lock(&q->lock);
+  q->busy = false;
+
+  qos_stats_t *s = &q->tenants[ticket->tenant].stats;
+  uint64_t latency = monotonic_ns() - ticket->arrival_ns;
+  int bucket = 0;
+  while (bucket < QOS_LATENCY_BUCKETS - 1 && latency >= (1000ULL << (bucket + 1)))
+    bucket++;
+  s->requests++;
+  s->bytes += ticket->bytes;
+  s->cost += ticket->cost;
+  s->latency[bucket]++;
+  if (latency > s->max_latency_ns)
+    s->max_latency_ns = latency;
+
+  pthread_cond_broadcast(&q->cond);
+  pthread_mutex_unlock(&q->lock);
+}
+
+int qos_stats(qos_t *q, int tenant, qos_stats_t *stats)
+{
+  if (tenant < 0 || tenant >= QOS_MAX_TENANTS || !stats)
+    return -1;
+  pthread_mutex_lock(&q->lock);
+  *stats = q->tenants[tenant].stats;
+  pthread_mutex_unlock(&q->lock);
+  return 0;
+}
+
+uint64_t qos_latency_percentile(const qos_stats_t *stats, double percentile)
+{
+  uint64_t target = (uint64_t)(stats->requests * percentile / 100 + 0.5), seen = 0;
+  for (int i = 0; i < QOS_LATENCY_BUCKETS; i++) {
+    seen += stats->latency[i];
+    if (seen >= target && seen > 0)
+      return (1000ULL << (i + 1)) < stats->max_latency_ns ? (1000ULL << (i + 1)) : stats->max_latency_ns;
+  }
+  return stats->max_latency_ns;
+}
@@ -0,0 +1,98 @@
+#ifndef QOS_H_
+#define QOS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/* A scheduler for requests from several tenants sharing one resource that
+ * serves a request at a time. Waiting requests are served in weighted fair
+ * queuing order: each gets a virtual finish tag of its tenant's previous tag
+ * (or the current virtual time, if later) plus its cost over the tenant's
+ * weight, and the smallest tag goes next. A tenant may also be held to token
+ * bucket limits in JBOD cost units and in bytes per second; while either
+ * bucket is in debt its requests wait, and the others go ahead. */
+
+#define QOS_MAX_TENANTS 16
+
+/* what jbod.o charges for each command, to estimate a request's cost */
+#define QOS_COST_MOUNT 1000
+#define QOS_COST_SEEK 50
+#define QOS_COST_READ_BLOCK 100
+#define QOS_COST_WRITE_BLOCK 200
+
+/* latencies are kept in power-of-two buckets of microseconds */
+#define QOS_LATENCY_BUCKETS 32
+
+typedef struct {
+  uint32_t weight;           /* share of the resource relative to other tenants, 0 for 1 */
+  uint64_t cost_per_sec;     /* 0 for no limit */
+  uint64_t cost_burst;       /* 0 for one second's worth */
+  uint64_t bytes_per_sec;    /* 0 for no limit */
+  uint64_t bytes_burst;      /* 0 for one second's worth */
+} qos_limits_t;
+
+typedef struct {
+  uint64_t requests;
+  uint64_t bytes;
+  uint64_t cost;
+  uint64_t throttled;        /* requests that waited for tokens */
+  uint64_t throttled_ns;     /* time those requests spent waiting */
+  uint64_t max_latency_ns;
+  uint64_t latency[QOS_LATENCY_BUCKETS];
+} qos_stats_t;
+
+typedef struct {
+  qos_limits_t limits;
+  double cost_tokens;
+  double byte_tokens;
+  int64_t refilled_ns;
+  double finish;             /* virtual finish tag of the last request */
+  qos_stats_t stats;
+} qos_tenant_t;
+
+typedef struct qos_waiter qos_waiter_t;
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  bool enabled;              /* off until a tenant is configured; requests then pass straight through */
+  bool busy;
+  double vtime;
+  qos_waiter_t *waiters;
+  qos_tenant_t tenants[QOS_MAX_TENANTS];
+} qos_t;
+
+#define QOS_INITIALIZER { .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER }
+
+/* one request, filled in by the caller before qos_acquire */
+typedef struct {
+  int tenant;
+  uint64_t cost;
+  uint64_t bytes;
+  /* set by qos_acquire */
+  bool scheduled;
+  int64_t arrival_ns;
+} qos_ticket_t;
+
+void qos_init(qos_t *q);
+void qos_destroy(qos_t *q);
+
+/* Returns 0 on success and -1 on failure. Sets the weight and limits of
+ * |tenant| and turns scheduling on. */
+int qos_set_tenant(qos_t *q, int tenant, const qos_limits_t *limits);
+
+/* Waits until it is |ticket|'s turn to use the resource. */
+void qos_acquire(qos_t *q, qos_ticket_t *ticket);
+
+/* Hands the resource on once |ticket|'s request is done. */
+void qos_release(qos_t *q, const qos_ticket_t *ticket);
+
+/* Returns 0 on success and -1 on failure. Copies the statistics of |tenant|. */
+int qos_stats(qos_t *q, int tenant, qos_stats_t *stats);
+
+/* The latency below which |percentile| percent of the requests in |stats|
+ * finished, rounded up to a bucket boundary, in nanoseconds. */
+uint64_t qos_latency_percentile(const qos_stats_t *stats, double percentile);
+
+#endif
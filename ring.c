@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "ring.h"
+#include "util.h"
+
+#define SPIN_MIN 64
+#define SPIN_MAX 65536
+#define SPIN_START 4096
+
+/* how long a sleeper waits before looking at the closed flag again */
+#define WAIT_SLICE_NS 100000000
+
+static int futex_wait(_Atomic uint32_t *addr, uint32_t val, int64_t deadline)
+{
+  int64_t slice = WAIT_SLICE_NS;
+  if (deadline != 0 && deadline - monotonic_ns() < slice)
+    slice = deadline - monotonic_ns();
+  if (slice <= 0)
+    return -1;
+  struct timespec ts = { 0, slice };
+  return syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t *addr)
+{
+  syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+/* waits until *tail moves past seen, the ring closes or the deadline (0 for
+ * none) passes. Spins for up to ring->spin iterations first and adapts the
+ * budget: a wait that ended while spinning grows it, one that had to sleep
+ * shrinks it. Returns false once the ring is closed or on timeout. */
+static bool wait_for(jbod_ring_t *ring, _Atomic uint32_t *tail, uint32_t seen, _Atomic uint32_t *waiting,
+                     int64_t deadline)
+{
+  jbod_ring_shared_t *sh = ring->shared;
+
+  for (int i = 0; i < ring->spin; i++) {
+    if (atomic_load_explicit(tail, memory_order_acquire) != seen) {
+      if (ring->spin < SPIN_MAX)
+        ring->spin *= 2;
+      return true;
+    }
+    cpu_relax();
+  }
+
+  if (ring->spin > SPIN_MIN)
+    ring->spin /= 2;
+
+  while (atomic_load(tail) == seen) {
+    if (atomic_load(&sh->closed))
+      return false;
+    if (deadline != 0 && monotonic_ns() >= deadline)
+      return false;
+    /* announce the sleep, then look again so a wakeup cannot be missed */
+    atomic_store(waiting, 1);
+    if (atomic_load(tail) == seen)
+      futex_wait(tail, seen, deadline);
+    atomic_store(waiting, 0);
+  }
+  return true;
+}
+
+static jbod_ring_t *map_ring(const char *name, int flags)
+{
+  int fd = shm_open(name, flags, S_IRUSR | S_IWUSR);
+  if (fd == -1)
+    return NULL;
+  if ((flags & O_CREAT) && ftruncate(fd, sizeof(jbod_ring_shared_t)) == -1) {
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+
+  void *addr = mmap(NULL, sizeof(jbod_ring_shared_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    if (flags & O_CREAT)
+      shm_unlink(name);
+    return NULL;
+  }
+
+  jbod_ring_t *ring = calloc(1, sizeof(jbod_ring_t));
+  if (!ring) {
+    munmap(addr, sizeof(jbod_ring_shared_t));
+    if (flags & O_CREAT)
+      shm_unlink(name);
+    return NULL;
+  }
+  ring->shared = addr;
+  ring->spin = SPIN_START;
+  snprintf(ring->name, sizeof(ring->name), "%s", name);
+  return ring;
+}
+
+jbod_ring_t *jbod_ring_create(void)
+{
+  static _Atomic uint32_t counter = 0;
+  char name[JBOD_RING_NAME_LEN];
+  snprintf(name, sizeof(name), "/jbod-ring-%d-%u", (int)getpid(), atomic_fetch_add(&counter, 1));
+
+  jbod_ring_t *ring = map_ring(name, O_CREAT | O_EXCL | O_RDWR);
+  if (!ring)
+    return NULL;
+  /* ftruncate zero-fills the segment, which is an empty ring */
+  ring->shared->magic = JBOD_RING_MAGIC;
+  return ring;
+}
+
+void jbod_ring_unlink(jbod_ring_t *ring)
+{
+  if (ring->name[0]) {
+    shm_unlink(ring->name);
+    ring->name[0] = '\0';
+  }
+}
+
+int jbod_ring_call(jbod_ring_t *ring, uint32_t op, const uint8_t *out, int outLen,
+                   uint8_t *in, int inCap, uint32_t *retOp, int *ret, int64_t deadline_ns)
+{
+  jbod_ring_shared_t *sh = ring->shared;
+  if (outLen > JBOD_RING_POOL_SIZE || atomic_load(&sh->closed))
+    return -1;
+
+  /* the connection has one request in flight, so the whole pool is ours */
+  if (outLen > 0)
+    memcpy(sh->pool, out, outLen);
+
+  uint32_t tail = atomic_load_explicit(&sh->sq_tail, memory_order_relaxed);
+  jbod_sqe_t *sqe = &sh->sq[tail & (JBOD_RING_ENTRIES - 1)];
+  sqe->op = op;
+  sqe->payload_off = 0;
+  sqe->payload_len = outLen;
+  sqe->tag = ring->next_tag++;
+  atomic_store(&sh->sq_tail, tail + 1);
+  if (atomic_load(&sh->server_waiting))
+    futex_wake(&sh->sq_tail);
+
+  uint32_t head = atomic_load_explicit(&sh->cq_head, memory_order_relaxed);
+  if (!wait_for(ring, &sh->cq_tail, head, &sh->client_waiting, deadline_ns))
+    return -1;
+
+  jbod_cqe_t *cqe = &sh->cq[head & (JBOD_RING_ENTRIES - 1)];
+  if (cqe->tag != sqe->tag || (int)cqe->payload_len > inCap) {
+    atomic_store(&sh->cq_head, head + 1);
+    return -1;
+  }
+  if (cqe->payload_len > 0)
+    memcpy(in, sh->pool, cqe->payload_len);
+  if (retOp)
+    *retOp = cqe->op;
+  *ret = cqe->ret;
+  atomic_store_explicit(&sh->cq_head, head + 1, memory_order_release);
+  return 0;
+}
+
+jbod_ring_t *jbod_ring_attach(const char *name)
+{
+  jbod_ring_t *ring = map_ring(name, O_RDWR);
+  if (!ring)
+    return NULL;
+  /* the name belongs to the client, which unlinks it */
+  ring->name[0] = '\0';
+  if (ring->shared->magic != JBOD_RING_MAGIC) {
+    munmap(ring->shared, sizeof(jbod_ring_shared_t));
+    free(ring);
+    return NULL;
+  }
+  return ring;
+}
+
+int jbod_ring_next(jbod_ring_t *ring, jbod_sqe_t *sqe)
+{
+  jbod_ring_shared_t *sh = ring->shared;
+  for (;;) {
+    uint32_t head = atomic_load_explicit(&sh->sq_head, memory_order_relaxed);
+    if (!wait_for(ring, &sh->sq_tail, head, &sh->server_waiting, 0))
+      return -1;
+
+    /* the client can still write the entry, so each field is read once */
+    const volatile jbod_sqe_t *entry = &sh->sq[head & (JBOD_RING_ENTRIES - 1)];
+    sqe->op = entry->op;
+    sqe->payload_off = entry->payload_off;
+    sqe->payload_len = entry->payload_len;
+    sqe->tag = entry->tag;
+    /* every request and response fits in the pool from its start, which is where the client puts them */
+    if (sqe->payload_off == 0 && sqe->payload_len <= JBOD_RING_POOL_SIZE)
+      return 0;
+    jbod_ring_complete(ring, sqe, sqe->op, -1, 0);
+  }
+}
+
+void jbod_ring_complete(jbod_ring_t *ring, const jbod_sqe_t *sqe, uint32_t op, int ret, uint32_t payloadLen)
+{
+  jbod_ring_shared_t *sh = ring->shared;
+  uint32_t tail = atomic_load_explicit(&sh->cq_tail, memory_order_relaxed);
+  jbod_cqe_t *cqe = &sh->cq[tail & (JBOD_RING_ENTRIES - 1)];
+  cqe->op = op;
+  cqe->ret = ret;
+  cqe->payload_len = payloadLen;
+  cqe->tag = sqe->tag;
+
+  atomic_store_explicit(&sh->sq_head, atomic_load(&sh->sq_head) + 1, memory_order_release);
+  atomic_store(&sh->cq_tail, tail + 1);
+  if (atomic_load(&sh->client_waiting))
+    futex_wake(&sh->cq_tail);
+}
+
+void jbod_ring_shutdown(jbod_ring_t *ring)
+{
+  jbod_ring_shared_t *sh = ring->shared;
+  atomic_store(&sh->closed, 1);
+  futex_wake(&sh->sq_tail);
+  futex_wake(&sh->cq_tail);
+}
+
+void jbod_ring_close(jbod_ring_t *ring)
+{
+  if (!ring)
+    return;
+  jbod_ring_shared_t *sh = ring->shared;
+  jbod_ring_shutdown(ring);
+  jbod_ring_unlink(ring);
+  munmap(sh, sizeof(jbod_ring_shared_t));
+  free(ring);
+}
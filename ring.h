@@ -0,0 +1,100 @@
+#ifndef RING_H_
+#define RING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "jbod.h"
+#include "net.h"
+
+/* Shared-memory transport between a client and a JBOD server on the same
+ * host. The client creates a POSIX shared memory segment holding a
+ * submission ring, a completion ring and a pool of block buffers, and hands
+ * its name to the server with JBOD_CMD_ATTACH_RING over the TCP connection.
+ * From then on requests go through the rings: payloads sit in the pool, and
+ * each side spins briefly before sleeping on a futex in the shared segment.
+ * The TCP connection stays open so either side notices when the other goes
+ * away. */
+
+#define JBOD_RING_MAGIC 0x4a424f52  /* "JBOR" */
+#define JBOD_RING_ENTRIES 16        /* power of two */
+#define JBOD_RING_POOL_SIZE JBOD_MAX_PAYLOAD
+#define JBOD_RING_NAME_LEN 64
+
+/* a request: the op, and where its payload sits in the pool */
+typedef struct {
+  uint32_t op;
+  uint32_t payload_off;
+  uint32_t payload_len;
+  uint32_t tag;
+} jbod_sqe_t;
+
+/* a response to the request with the same tag */
+typedef struct {
+  uint32_t op;
+  int32_t ret;
+  uint32_t payload_len;
+  uint32_t tag;
+} jbod_cqe_t;
+
+/* the layout of the shared segment */
+typedef struct {
+  uint32_t magic;
+  /* producer and consumer indexes, free-running; the futexes sleep on the tails */
+  _Atomic uint32_t sq_head;
+  _Atomic uint32_t sq_tail;
+  _Atomic uint32_t cq_head;
+  _Atomic uint32_t cq_tail;
+  /* set by a side that is about to sleep, so the other side knows to wake it */
+  _Atomic uint32_t server_waiting;
+  _Atomic uint32_t client_waiting;
+  _Atomic uint32_t closed;
+  jbod_sqe_t sq[JBOD_RING_ENTRIES];
+  jbod_cqe_t cq[JBOD_RING_ENTRIES];
+  uint8_t pool[JBOD_RING_POOL_SIZE];
+} jbod_ring_shared_t;
+
+/* one side's handle on a mapped ring */
+typedef struct jbod_ring {
+  jbod_ring_shared_t *shared;
+  char name[JBOD_RING_NAME_LEN];
+  uint32_t next_tag;
+  /* iterations to busy-poll before sleeping, adapted to how long requests take */
+  int spin;
+} jbod_ring_t;
+
+/* client side: creates and maps a new segment; returns NULL on failure */
+jbod_ring_t *jbod_ring_create(void);
+
+/* client side: removes the segment name once the server has it mapped, or
+ * when the server refused it */
+void jbod_ring_unlink(jbod_ring_t *ring);
+
+/* client side: sends one request through the ring and waits for its
+ * response until |deadline_ns| (CLOCK_MONOTONIC, 0 for none). Returns 0 on
+ * success and -1 on failure; |ret| receives the server's return code. After
+ * a timeout the request is still outstanding, so the ring must be closed. */
+int jbod_ring_call(jbod_ring_t *ring, uint32_t op, const uint8_t *out, int outLen,
+                   uint8_t *in, int inCap, uint32_t *retOp, int *ret, int64_t deadline_ns);
+
+/* server side: maps the segment the client named; returns NULL on failure */
+jbod_ring_t *jbod_ring_attach(const char *name);
+
+/* server side: waits for the next request and copies it into |sqe|, so the
+ * client cannot change it once checked. Its payload, and the response's,
+ * sit at the start of the pool; requests that say otherwise are failed
+ * here. Returns 0, or -1 once the ring is closed. */
+int jbod_ring_next(jbod_ring_t *ring, jbod_sqe_t *sqe);
+
+/* server side: completes the request returned by jbod_ring_next */
+void jbod_ring_complete(jbod_ring_t *ring, const jbod_sqe_t *sqe, uint32_t op, int ret, uint32_t payloadLen);
+
+/* either side: marks the ring closed and wakes the other side, which then
+ * stops waiting on it */
+void jbod_ring_shutdown(jbod_ring_t *ring);
+
+/* either side: shuts the ring down and unmaps it */
+void jbod_ring_close(jbod_ring_t *ring);
+
+#endif
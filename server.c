@@ -0,0 +1,514 @@
+/*
+  Stand-in JBOD server. Serves the in-process JBOD from jbod.o over the wire
+  protocol in net.h: every v1 command, plus the v2 handshake and extent
+  commands and the v3 geometry and wide extent commands. With -g the
+  extent commands see the JBOD's blocks laid out as an array of another
+  shape, for trying clients against geometries jbod.o cannot provide; the
+  v1 commands always address the JBOD itself. Each client gets its own thread; the JBOD itself is shared, so
+  operations are serialized and each client's seek position is put back
+  before its reads and writes. A client on the same host may move its
+  requests onto a shared memory ring (ring.h), which then gets a thread of
+  its own.
+*/
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <signal.h>
+#include <errno.h>
+#include <err.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "jbod.h"
+#include "net.h"
+#include "util.h"
+#include "tester.h"
+#include "ring.h"
+#include "geometry.h"
+
+#define SERVER_ARGUMENTS "hp:vg:"
+#define USAGE                                               \
+  "USAGE: server [-h] [-v] [-p port] [-g disksxblocks]\n"   \
+  "\n"                                                      \
+  "where:\n"                                                \
+  "    -h - help mode (display this message)\n"             \
+  "    -v - log every request and the JBOD operations it runs to stderr\n" \
+  "    -p - port to listen on (default 3333)\n"             \
+  "    -g - geometry to present, e.g. 64x64; at most as many blocks as the JBOD has\n" \
+  "\n"                                                      \
+
+/* what the server knows about one client */
+typedef struct {
+  int sd;
+  /* where this client left the JBOD, or -1 when unknown */
+  int disk;
+  int block;
+  /* the shared memory ring this client attached, and the thread serving it */
+  jbod_ring_t *ring;
+  pthread_t ring_thread;
+} client_t;
+
+/* serializes access to the JBOD, which is a single global in jbod.o */
+static pthread_mutex_t jbod_lock = PTHREAD_MUTEX_INITIALIZER;
+/* the client whose seek position the JBOD currently holds */
+static client_t *jbod_owner = NULL;
+/* the array the extent commands address, mapped block for block onto the JBOD */
+static jbod_geometry_t geometry;
+
+static void signal_handler(int sig)
+{
+  jbod_print_cost();
+  exit(0);
+}
+
+/* reads exactly len bytes from fd; returns true on success and false on failure */
+static bool nread(int fd, int len, uint8_t *buf)
+{
+  int numRead = 0;
+  while (numRead < len)
+  {
+    int n = read(fd, &buf[numRead], len - numRead);
+    if (n <= 0)
+    {
+      if (n == -1 && errno == EINTR)
+      {
+        continue;
+      }
+      return false;
+    }
+    numRead += n;
+  }
+  return true;
+}
+
+/* writes exactly len bytes to fd; returns true on success and false on failure */
+static bool nwrite(int fd, int len, const uint8_t *buf)
+{
+  int numWritten = 0;
+  while (numWritten < len)
+  {
+    int n = write(fd, &buf[numWritten], len - numWritten);
+    if (n <= 0)
+    {
+      if (n == -1 && errno == EINTR)
+      {
+        continue;
+      }
+      return false;
+    }
+    numWritten += n;
+  }
+  return true;
+}
+
+/* receives one request; payload receives up to payloadCap bytes following the header */
+static bool recv_packet(int sd, uint32_t *op, uint8_t *payload, int payloadCap, int *payloadLen)
+{
+  uint8_t header[HEADER_LEN];
+  if (!nread(sd, HEADER_LEN, header))
+  {
+    return false;
+  }
+  uint16_t len;
+  memcpy(&len, &header[0], sizeof(uint16_t));
+  memcpy(op, &header[sizeof(uint16_t)], sizeof(uint32_t));
+  len = ntohs(len);
+  *op = ntohl(*op);
+
+  *payloadLen = len - (int)HEADER_LEN;
+  if (*payloadLen < 0 || *payloadLen > payloadCap)
+  {
+    return false;
+  }
+  return *payloadLen == 0 || nread(sd, *payloadLen, payload);
+}
+
+/* sends one response with the given return code and payload */
+static bool send_packet(int sd, uint32_t op, int ret, const uint8_t *payload, int payloadLen)
+{
+  uint8_t packet[HEADER_LEN + JBOD_MAX_PAYLOAD];
+  uint16_t nLength = htons(HEADER_LEN + payloadLen);
+  uint32_t nOp = htonl(op);
+  uint16_t nRet = htons((uint16_t)ret);
+  memcpy(&packet[0], &nLength, sizeof(uint16_t));
+  memcpy(&packet[sizeof(uint16_t)], &nOp, sizeof(uint32_t));
+  memcpy(&packet[sizeof(uint16_t) + sizeof(uint32_t)], &nRet, sizeof(uint16_t));
+  if (payloadLen > 0)
+  {
+    memcpy(&packet[HEADER_LEN], payload, payloadLen);
+  }
+  return nwrite(sd, HEADER_LEN + payloadLen, packet);
+}
+
+static uint32_t jbod_op(int command, int disk, int block)
+{
+  return ((uint32_t)disk << 28) | ((uint32_t)block << 20) | ((uint32_t)command << 14);
+}
+
+/* moves the JBOD to disk/block for cli, skipping seeks it is already at */
+static int seek_for(client_t *cli, int disk, int block)
+{
+  bool owned = (jbod_owner == cli);
+  if (!owned || cli->disk != disk)
+  {
+    if (jbod_operation(jbod_op(JBOD_SEEK_TO_DISK, disk, 0), NULL) == -1)
+    {
+      cli->disk = -1;
+      return -1;
+    }
+    jbod_owner = cli;
+    cli->disk = disk;
+    cli->block = 0;
+  }
+  if (cli->block != block)
+  {
+    if (jbod_operation(jbod_op(JBOD_SEEK_TO_BLOCK, 0, block), NULL) == -1)
+    {
+      cli->disk = -1;
+      return -1;
+    }
+    cli->block = block;
+  }
+  return 0;
+}
+
+/* runs a v1 command for cli, first putting back the position its reads and writes depend on */
+static int do_v1(client_t *cli, uint32_t op, uint8_t *block)
+{
+  int command = (op >> 14) & 0x3f;
+  if ((command == JBOD_READ_BLOCK || command == JBOD_WRITE_BLOCK) && jbod_owner != cli && cli->disk != -1)
+  {
+    if (seek_for(cli, cli->disk, cli->block) == -1)
+    {
+      return -1;
+    }
+  }
+
+  int rc = jbod_operation(op, block);
+  switch (command)
+  {
+    case JBOD_MOUNT:
+    case JBOD_UNMOUNT:
+      cli->disk = -1;
+      break;
+    case JBOD_SEEK_TO_DISK:
+      cli->disk = (rc == 0) ? (int)(op >> 28) : -1;
+      cli->block = 0;
+      jbod_owner = cli;
+      break;
+    case JBOD_SEEK_TO_BLOCK:
+      cli->block = (op >> 20) & 0xff;
+      if (rc == -1)
+      {
+        cli->disk = -1;
+      }
+      jbod_owner = cli;
+      break;
+    case JBOD_READ_BLOCK:
+    case JBOD_WRITE_BLOCK:
+      cli->block++;
+      if (rc == -1)
+      {
+        cli->disk = -1;
+      }
+      break;
+    default:
+      break;
+  }
+  return rc;
+}
+
+/* runs a read or write extent for cli; disk and block are in the presented geometry and
+ * blocks holds count blocks */
+static int do_extent(client_t *cli, bool write, uint32_t disk, uint32_t block, int count, uint8_t *blocks)
+{
+  if (count == 0 || disk >= geometry.num_disks || block + count > geometry.blocks_per_disk)
+  {
+    return -1;
+  }
+  uint32_t first = jbod_geometry_global(&geometry, disk, block);
+  for (int i = 0; i < count; i++)
+  {
+    /* a presented disk may span JBOD disks; seek_for skips seeks the JBOD is already at */
+    int jbodDisk, jbodBlock;
+    jbod_geometry_locate(jbod_geometry_default(), first + i, &jbodDisk, &jbodBlock);
+    if (seek_for(cli, jbodDisk, jbodBlock) == -1)
+    {
+      return -1;
+    }
+    if (jbod_operation(jbod_op(write ? JBOD_WRITE_BLOCK : JBOD_READ_BLOCK, 0, 0), blocks + i * JBOD_BLOCK_SIZE) == -1)
+    {
+      cli->disk = -1;
+      return -1;
+    }
+    cli->block++;
+  }
+  return 0;
+}
+
+/* reads the address header of a wide extent command */
+static void get_extent_addr(const uint8_t *payload, uint32_t *disk, uint32_t *block)
+{
+  memcpy(disk, payload, sizeof(uint32_t));
+  memcpy(block, payload + sizeof(uint32_t), sizeof(uint32_t));
+  *disk = ntohl(*disk);
+  *block = ntohl(*block);
+}
+
+/* runs one request for cli in place: payload holds payloadLen bytes of request data and
+ * receives the response data, whose length goes to outLen. Returns the JBOD return code. */
+static int dispatch(client_t *cli, uint32_t op, uint8_t *payload, int payloadLen, uint32_t *outOp, int *outLen)
+{
+  int command = (op >> 14) & 0x3f;
+  int count = op & 0xff;
+  int rc = -1;
+  *outOp = op;
+  *outLen = 0;
+
+  pthread_mutex_lock(&jbod_lock);
+  switch (command)
+  {
+    case JBOD_CMD_HELLO:
+    {
+      /* agree to the lower of the two versions */
+      int version = op & 0xff;
+      if (version > JBOD_PROTO_VERSION)
+      {
+        version = JBOD_PROTO_VERSION;
+      }
+      *outOp = (op & ~0xffu) | version;
+      rc = (version >= JBOD_PROTO_V1) ? 0 : -1;
+      break;
+    }
+    case JBOD_CMD_READ_EXTENT:
+      rc = do_extent(cli, false, op >> 28, (op >> 20) & 0xff, count, payload);
+      *outLen = (rc == 0) ? count * JBOD_BLOCK_SIZE : 0;
+      break;
+    case JBOD_CMD_WRITE_EXTENT:
+      if (payloadLen == count * JBOD_BLOCK_SIZE)
+      {
+        rc = do_extent(cli, true, op >> 28, (op >> 20) & 0xff, count, payload);
+      }
+      break;
+    case JBOD_CMD_READ_EXTENT_WIDE:
+    case JBOD_CMD_WRITE_EXTENT_WIDE:
+    {
+      bool write = (command == JBOD_CMD_WRITE_EXTENT_WIDE);
+      int expected = JBOD_EXTENT_ADDR_LEN + (write ? count * JBOD_BLOCK_SIZE : 0);
+      if (payloadLen != expected)
+      {
+        break;
+      }
+      uint32_t disk, block;
+      get_extent_addr(payload, &disk, &block);
+      /* the blocks of a write follow the address; those of a read replace it */
+      rc = do_extent(cli, write, disk, block, count, write ? payload + JBOD_EXTENT_ADDR_LEN : payload);
+      *outLen = (rc == 0 && !write) ? count * JBOD_BLOCK_SIZE : 0;
+      break;
+    }
+    case JBOD_CMD_GEOMETRY:
+    {
+      uint32_t fields[3] = { htonl(geometry.num_disks), htonl(geometry.blocks_per_disk), htonl(JBOD_BLOCK_SIZE) };
+      memcpy(payload, fields, sizeof(fields));
+      *outLen = sizeof(fields);
+      rc = 0;
+      break;
+    }
+    case JBOD_CMD_ATTACH_RING:
+      /* only meaningful over TCP, see handle_cli */
+      break;
+    default:
+      if (command == JBOD_WRITE_BLOCK && payloadLen != JBOD_BLOCK_SIZE)
+      {
+        break;
+      }
+      rc = do_v1(cli, op, (command == JBOD_READ_BLOCK || command == JBOD_WRITE_BLOCK ||
+                           command == JBOD_SIGN_BLOCK) ? payload : NULL);
+      if (rc == 0 && (command == JBOD_READ_BLOCK || command == JBOD_SIGN_BLOCK))
+      {
+        *outLen = JBOD_BLOCK_SIZE;
+      }
+      break;
+  }
+  /* -v; logged under the lock so the lines come out in the order the JBOD ran them. The disk and block are the
+   * op's, which wide extents carry in the payload instead */
+  debug_log("client %d: command %d disk %u block %u count %d, %d bytes in: rc %d, %d bytes out", cli->sd, command,
+            op >> 28, (op >> 20) & 0xff, count, payloadLen, rc, *outLen);
+  pthread_mutex_unlock(&jbod_lock);
+  return rc;
+}
+
+/* serves requests from cli's shared memory ring until the ring closes. Requests are
+ * handled in place at the start of the ring's buffer pool, which holds the largest
+ * response dispatch gives (JBOD_MAX_PAYLOAD). */
+static void *serve_ring(void *arg)
+{
+  client_t *cli = arg;
+  jbod_sqe_t sqe;
+
+  while (jbod_ring_next(cli->ring, &sqe) == 0)
+  {
+    uint32_t outOp;
+    int outLen;
+    int rc = dispatch(cli, sqe.op, cli->ring->shared->pool, sqe.payload_len, &outOp, &outLen);
+    jbod_ring_complete(cli->ring, &sqe, outOp, rc, outLen);
+  }
+  return NULL;
+}
+
+/* maps the ring named in payload and starts serving it; returns the JBOD return code */
+static int attach_ring(client_t *cli, const uint8_t *payload, int payloadLen)
+{
+  char name[JBOD_RING_NAME_LEN];
+  if (cli->ring != NULL || payloadLen <= 0 || payloadLen > JBOD_RING_NAME_LEN || payload[payloadLen - 1] != '\0')
+  {
+    return -1;
+  }
+  memcpy(name, payload, payloadLen);
+
+  cli->ring = jbod_ring_attach(name);
+  if (cli->ring == NULL)
+  {
+    return -1;
+  }
+  if (pthread_create(&cli->ring_thread, NULL, serve_ring, cli) != 0)
+  {
+    jbod_ring_close(cli->ring);
+    cli->ring = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+/* serves one client until it disconnects */
+static void *handle_cli(void *arg)
+{
+  client_t *cli = arg;
+  uint8_t payload[JBOD_MAX_PAYLOAD];
+  uint32_t op;
+  int payloadLen;
+
+  while (recv_packet(cli->sd, &op, payload, sizeof(payload), &payloadLen))
+  {
+    uint32_t outOp = op;
+    int outLen = 0;
+    int rc;
+    if (((op >> 14) & 0x3f) == JBOD_CMD_ATTACH_RING)
+    {
+      rc = attach_ring(cli, payload, payloadLen);
+    }
+    else
+    {
+      rc = dispatch(cli, op, payload, payloadLen, &outOp, &outLen);
+    }
+
+    if (!send_packet(cli->sd, outOp, rc, payload, outLen))
+    {
+      break;
+    }
+  }
+
+  /* the ring thread may still be waiting on the ring, so stop it before letting go */
+  if (cli->ring != NULL)
+  {
+    jbod_ring_shutdown(cli->ring);
+    pthread_join(cli->ring_thread, NULL);
+    jbod_ring_close(cli->ring);
+  }
+
+  pthread_mutex_lock(&jbod_lock);
+  if (jbod_owner == cli)
+  {
+    jbod_owner = NULL;
+  }
+  pthread_mutex_unlock(&jbod_lock);
+  close(cli->sd);
+  free(cli);
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  int ch;
+  uint16_t port = JBOD_PORT;
+  unsigned disks, blocks;
+
+  geometry = *jbod_geometry_default();
+
+  while ((ch = getopt(argc, argv, SERVER_ARGUMENTS)) != -1) {
+    switch (ch) {
+      case 'h':
+        fprintf(stderr, USAGE);
+        return 0;
+      case 'v':
+        enable_debug_log();
+        break;
+      case 'p':
+        port = atoi(optarg);
+        break;
+      case 'g':
+        if (sscanf(optarg, "%ux%u", &disks, &blocks) != 2 || jbod_geometry_init(&geometry, disks, blocks) != 1 ||
+            jbod_geometry_blocks(&geometry) > jbod_geometry_blocks(jbod_geometry_default())) {
+          fprintf(stderr, "Bad geometry (%s), aborting.\n", optarg);
+          return -1;
+        }
+        break;
+      default:
+        fprintf(stderr, "Unknown command line option (%c), aborting.\n", ch);
+        return -1;
+    }
+  }
+
+  signal(SIGINT, signal_handler);
+  signal(SIGTERM, signal_handler);
+  signal(SIGPIPE, SIG_IGN);
+
+  int sd = socket(AF_INET, SOCK_STREAM, 0);
+  if (sd == -1)
+    err(1, "socket");
+  int enable = 1;
+  setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(sd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+    err(1, "bind");
+  if (listen(sd, 16) == -1)
+    err(1, "listen");
+  fprintf(stderr, "JBOD server listening on port %d...\n", port);
+
+  while (1) {
+    int csd = accept(sd, NULL, NULL);
+    if (csd == -1) {
+      if (errno == EINTR)
+        continue;
+      err(1, "accept");
+    }
+    client_t *cli = calloc(1, sizeof(client_t));
+    if (!cli) {
+      close(csd);
+      continue;
+    }
+    cli->sd = csd;
+    cli->disk = -1;
+    cli->block = -1;
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, handle_cli, cli) != 0) {
+      close(csd);
+      free(cli);
+      continue;
+    }
+    pthread_detach(tid);
+  }
+
+  return 0;
+}
@@ -0,0 +1,354 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shcache.h"
+#include "util.h"
+
+#define SHCACHE_MAGIC 0x4a424f43  /* "JBOC" */
+#define NO_KEY UINT64_MAX
+/* how long an opener waits for the creator to finish setting a segment up */
+#define OPEN_WAIT_NS 1000000000
+
+typedef struct {
+  _Atomic uint32_t seq;  /* odd while the chain or its blocks are changing */
+  _Atomic int32_t head;
+} shcache_bucket_t;
+
+typedef struct {
+  _Atomic uint64_t key;  /* NO_KEY while free */
+  _Atomic int32_t next;  /* along the hash chain, or the free list */
+  _Atomic uint8_t referenced;
+  uint8_t block[JBOD_BLOCK_SIZE];
+} shcache_entry_t;
+
+typedef struct {
+  _Atomic uint32_t magic;
+  uint32_t num_entries;
+  uint32_t bucket_mask;
+  /* taken by everything that changes the cache; lookups go without */
+  pthread_mutex_t lock;
+  _Atomic uint64_t write_count;
+  uint32_t hand;
+  int32_t free_head;
+  _Atomic uint64_t lookups;
+  _Atomic uint64_t hits;
+} shcache_header_t;
+
+struct shcache {
+  shcache_header_t *hdr;
+  shcache_bucket_t *buckets;
+  shcache_entry_t *entries;
+  size_t size;
+};
+
+static uint32_t num_buckets_for(uint32_t num_entries)
+{
+  uint32_t n = 1;
+  while (n < num_entries)
+    n <<= 1;
+  return n;
+}
+
+static size_t segment_size(uint32_t num_entries)
+{
+  return sizeof(shcache_header_t) + num_buckets_for(num_entries) * sizeof(shcache_bucket_t) +
+         (size_t)num_entries * sizeof(shcache_entry_t);
+}
+
+static void attach(shcache_t *sh, void *addr, size_t size)
+{
+  sh->hdr = addr;
+  sh->buckets = (shcache_bucket_t *)(sh->hdr + 1);
+  sh->entries = (shcache_entry_t *)(sh->buckets + sh->hdr->bucket_mask + 1);
+  sh->size = size;
+}
+
+static shcache_bucket_t *bucket_of(shcache_t *sh, uint64_t key)
+{
+  return &sh->buckets[mix64(key) & sh->hdr->bucket_mask];
+}
+
+static void write_begin(shcache_bucket_t *b)
+{
+  atomic_store_explicit(&b->seq, atomic_load_explicit(&b->seq, memory_order_relaxed) + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+}
+
+static void write_end(shcache_bucket_t *b)
+{
+  atomic_store_explicit(&b->seq, atomic_load_explicit(&b->seq, memory_order_relaxed) + 1, memory_order_release);
+}
+
+/* empties every chain and puts every entry on the free list */
+static void reset(shcache_t *sh)
+{
+  shcache_header_t *hdr = sh->hdr;
+  for (uint32_t b = 0; b <= hdr->bucket_mask; b++) {
+    write_begin(&sh->buckets[b]);
+    atomic_store_explicit(&sh->buckets[b].head, -1, memory_order_relaxed);
+    write_end(&sh->buckets[b]);
+  }
+  for (uint32_t i = 0; i < hdr->num_entries; i++) {
+    atomic_store_explicit(&sh->entries[i].key, NO_KEY, memory_order_relaxed);
+    atomic_store_explicit(&sh->entries[i].next, (int32_t)i + 1 < (int32_t)hdr->num_entries ? (int32_t)i + 1 : -1,
+                          memory_order_relaxed);
+  }
+  hdr->free_head = 0;
+  hdr->hand = 0;
+  atomic_fetch_add(&hdr->write_count, 1);
+}
+
+static void lock(shcache_t *sh)
+{
+  /* the owner died part way through a change, so nothing in the cache can be trusted */
+  if (pthread_mutex_lock(&sh->hdr->lock) == EOWNERDEAD) {
+    reset(sh);
+    pthread_mutex_consistent(&sh->hdr->lock);
+  }
+}
+
+static void unlock(shcache_t *sh)
+{
+  pthread_mutex_unlock(&sh->hdr->lock);
+}
+
+static int init_lock(shcache_t *sh)
+{
+  pthread_mutexattr_t attr;
+  if (pthread_mutexattr_init(&attr) != 0)
+    return -1;
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+  int rc = pthread_mutex_init(&sh->hdr->lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+  if (rc != 0)
+    return -1;
+  return 0;
+}
+
+shcache_t *shcache_open(const char *name, int num_entries)
+{
+  if (num_entries <= 0)
+    return NULL;
+  shcache_t *sh = calloc(1, sizeof(shcache_t));
+  if (!sh)
+    return NULL;
+
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+  if (fd != -1) {
+    size_t size = segment_size(num_entries);
+    void *addr;
+    if (ftruncate(fd, size) == -1 ||
+        (addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+      close(fd);
+      shm_unlink(name);
+      free(sh);
+      return NULL;
+    }
+    close(fd);
+    /* ftruncate zero-fills the segment; attach needs its shape first */
+    shcache_header_t *hdr = addr;
+    hdr->num_entries = num_entries;
+    hdr->bucket_mask = num_buckets_for(num_entries) - 1;
+    attach(sh, addr, size);
+    if (init_lock(sh) == -1) {
+      munmap(addr, size);
+      shm_unlink(name);
+      free(sh);
+      return NULL;
+    }
+    reset(sh);
+    atomic_store_explicit(&sh->hdr->magic, SHCACHE_MAGIC, memory_order_release);
+    return sh;
+  }
+  if (errno != EEXIST || (fd = shm_open(name, O_RDWR, 0)) == -1) {
+    free(sh);
+    return NULL;
+  }
+
+  /* another process created the segment; waits for it to be sized and set up */
+  int64_t deadline = monotonic_ns() + OPEN_WAIT_NS;
+  struct stat st;
+  while (fstat(fd, &st) == 0 && st.st_size < (off_t)sizeof(shcache_header_t) && monotonic_ns() < deadline)
+    sched_yield();
+  void *addr = MAP_FAILED;
+  if (st.st_size >= (off_t)sizeof(shcache_header_t))
+    addr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    free(sh);
+    return NULL;
+  }
+  shcache_header_t *hdr = addr;
+  while (atomic_load_explicit(&hdr->magic, memory_order_acquire) != SHCACHE_MAGIC && monotonic_ns() < deadline)
+    sched_yield();
+  if (atomic_load_explicit(&hdr->magic, memory_order_acquire) != SHCACHE_MAGIC ||
+      segment_size(hdr->num_entries) != (size_t)st.st_size) {
+    munmap(addr, st.st_size);
+    free(sh);
+    return NULL;
+  }
+  attach(sh, addr, st.st_size);
+  return sh;
+}
+
+void shcache_close(shcache_t *sh)
+{
+  if (!sh)
+    return;
+  munmap(sh->hdr, sh->size);
+  free(sh);
+}
+
+int shcache_unlink(const char *name)
+{
+  return shm_unlink(name);
+}
+
+bool shcache_lookup(shcache_t *sh, uint64_t key, uint8_t *buf)
+{
+  shcache_bucket_t *b = bucket_of(sh, key);
+  uint32_t n = sh->hdr->num_entries;
+  atomic_fetch_add_explicit(&sh->hdr->lookups, 1, memory_order_relaxed);
+
+  for (;;) {
+    uint32_t seq = atomic_load_explicit(&b->seq, memory_order_acquire);
+    if (seq & 1) {
+      sched_yield();
+      continue;
+    }
+    /* the chain may change under the walk; the bound keeps a torn one from looping */
+    int32_t found = -1;
+    uint32_t steps = 0;
+    for (int32_t i = atomic_load_explicit(&b->head, memory_order_relaxed); i >= 0 && (uint32_t)i < n && steps++ < n;
+         i = atomic_load_explicit(&sh->entries[i].next, memory_order_relaxed)) {
+      if (atomic_load_explicit(&sh->entries[i].key, memory_order_relaxed) == key) {
+        memcpy(buf, sh->entries[i].block, JBOD_BLOCK_SIZE);
+        found = i;
+        break;
+      }
+    }
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&b->seq, memory_order_relaxed) != seq)
+      continue;
+    if (found == -1)
+      return false;
+    atomic_store_explicit(&sh->entries[found].referenced, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&sh->hdr->hits, 1, memory_order_relaxed);
+    return true;
+  }
+}
+
+uint64_t shcache_token(shcache_t *sh)
+{
+  return atomic_load(&sh->hdr->write_count);
+}
+
+/* the entry for |key| on chain |b|, or -1; called with the lock held */
+static int32_t find_locked(shcache_t *sh, shcache_bucket_t *b, uint64_t key)
+{
+  for (int32_t i = atomic_load_explicit(&b->head, memory_order_relaxed); i != -1;
+       i = atomic_load_explicit(&sh->entries[i].next, memory_order_relaxed))
+    if (atomic_load_explicit(&sh->entries[i].key, memory_order_relaxed) == key)
+      return i;
+  return -1;
+}
+
+static void unlink_locked(shcache_t *sh, int32_t i)
+{
+  shcache_entry_t *e = &sh->entries[i];
+  shcache_bucket_t *b = bucket_of(sh, atomic_load_explicit(&e->key, memory_order_relaxed));
+  write_begin(b);
+  _Atomic int32_t *link = &b->head;
+  while (atomic_load_explicit(link, memory_order_relaxed) != i)
+    link = &sh->entries[atomic_load_explicit(link, memory_order_relaxed)].next;
+  atomic_store_explicit(link, atomic_load_explicit(&e->next, memory_order_relaxed), memory_order_relaxed);
+  write_end(b);
+}
+
+/* second chance: sweeps past referenced entries, clearing their bits, and evicts the first that is not */
+static int32_t evict_locked(shcache_t *sh)
+{
+  shcache_header_t *hdr = sh->hdr;
+  for (;;) {
+    int32_t i = hdr->hand;
+    hdr->hand = (hdr->hand + 1) % hdr->num_entries;
+    if (atomic_exchange_explicit(&sh->entries[i].referenced, 0, memory_order_relaxed))
+      continue;
+    unlink_locked(sh, i);
+    return i;
+  }
+}
+
+bool shcache_insert(shcache_t *sh, uint64_t key, const uint8_t *buf, uint64_t token)
+{
+  shcache_bucket_t *b = bucket_of(sh, key);
+  lock(sh);
+  /* the block may predate a write that another process has made since */
+  if (atomic_load(&sh->hdr->write_count) != token) {
+    unlock(sh);
+    return false;
+  }
+
+  int32_t i = find_locked(sh, b, key);
+  if (i != -1) {
+    write_begin(b);
+    memcpy(sh->entries[i].block, buf, JBOD_BLOCK_SIZE);
+    write_end(b);
+    unlock(sh);
+    return true;
+  }
+
+  if (sh->hdr->free_head != -1) {
+    i = sh->hdr->free_head;
+    sh->hdr->free_head = atomic_load_explicit(&sh->entries[i].next, memory_order_relaxed);
+  } else {
+    i = evict_locked(sh);
+  }
+
+  /* the entry is on no chain now, so no lookup can be reading it */
+  shcache_entry_t *e = &sh->entries[i];
+  write_begin(b);
+  atomic_store_explicit(&e->key, key, memory_order_relaxed);
+  memcpy(e->block, buf, JBOD_BLOCK_SIZE);
+  atomic_store_explicit(&e->referenced, 0, memory_order_relaxed);
+  atomic_store_explicit(&e->next, atomic_load_explicit(&b->head, memory_order_relaxed), memory_order_relaxed);
+  atomic_store_explicit(&b->head, i, memory_order_relaxed);
+  write_end(b);
+  unlock(sh);
+  return true;
+}
+
+void shcache_invalidate(shcache_t *sh, uint64_t key)
+{
+  lock(sh);
+  atomic_fetch_add(&sh->hdr->write_count, 1);
+  int32_t i = find_locked(sh, bucket_of(sh, key), key);
+  if (i != -1) {
+    unlink_locked(sh, i);
+    atomic_store_explicit(&sh->entries[i].key, NO_KEY, memory_order_relaxed);
+    atomic_store_explicit(&sh->entries[i].next, sh->hdr->free_head, memory_order_relaxed);
+    sh->hdr->free_head = i;
+  }
+  unlock(sh);
+}
+
+int shcache_size(const shcache_t *sh)
+{
+  return sh->hdr->num_entries;
+}
+
+void shcache_stats(const shcache_t *sh, uint64_t *lookups, uint64_t *hits)
+{
+  *lookups = atomic_load(&sh->hdr->lookups);
+  *hits = atomic_load(&sh->hdr->hits);
+}
@@ -0,0 +1,58 @@
+#ifndef SHCACHE_H_
+#define SHCACHE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "jbod.h"
+
+/* A block cache in a named POSIX shared memory segment, used by every
+ * process that opens the same name.
+ *
+ * Lookups take no lock: each hash bucket has a sequence count that is odd
+ * while its chain or the blocks on it are changing, and a lookup that sees
+ * it change retries. Inserts and invalidations take a process-shared robust
+ * mutex; if a process dies holding it, the next one empties the cache and
+ * carries on. Eviction is CLOCK, so a hit only sets a bit.
+ *
+ * A block fetched after a miss must not overwrite a newer write by another
+ * process. Every invalidation bumps a write count; a filler takes a token
+ * (the count) before it fetches, and its insert is dropped if the count has
+ * moved since. Writers therefore invalidate a block after it reaches the
+ * JBOD rather than inserting it. */
+
+#define SHCACHE_NAME_LEN 64
+
+typedef struct shcache shcache_t;
+
+/* Returns the cache in the segment |name| (e.g. "/mdadm-cache"), creating
+ * it with |num_entries| entries if it does not exist yet, or NULL on
+ * failure. A segment that already exists keeps its own size. */
+shcache_t *shcache_open(const char *name, int num_entries);
+
+/* Unmaps the cache. The segment stays for the other processes. */
+void shcache_close(shcache_t *sh);
+
+/* Returns 0 on success and -1 on failure. Removes the segment name; the
+ * processes that have it mapped keep using it. */
+int shcache_unlink(const char *name);
+
+/* Returns true and copies the block for |key| into |buf| if it is cached. */
+bool shcache_lookup(shcache_t *sh, uint64_t key, uint8_t *buf);
+
+/* The token to pass to shcache_insert for a block about to be fetched. */
+uint64_t shcache_token(shcache_t *sh);
+
+/* Caches |buf| for |key| unless a block was invalidated after |token| was
+ * taken; returns whether it did. */
+bool shcache_insert(shcache_t *sh, uint64_t key, const uint8_t *buf, uint64_t token);
+
+/* Drops |key| if it is cached, and stops inserts of blocks fetched before now. */
+void shcache_invalidate(shcache_t *sh, uint64_t key);
+
+int shcache_size(const shcache_t *sh);
+
+/* lookups and hits by every process using the segment */
+void shcache_stats(const shcache_t *sh, uint64_t *lookups, uint64_t *hits);
+
+#endif
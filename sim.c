@@ -0,0 +1,364 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <err.h>
+
+#include "sim.h"
+#include "cache.h"
+#include "util.h"
+
+#define SIM_ARGUMENTS "hw:s:j:"
+#define USAGE                                               \
+  "USAGE: sim [-h] -w workload-file [-s sizes] [-j jobs]\n" \
+  "\n"                                                      \
+  "where:\n"                                                \
+  "    -h - help mode (display this message)\n"             \
+  "    -w - tester workload to replay\n"                    \
+  "    -s - comma-separated cache sizes to try, 0 for none (default 0,16,64,256,1024,4096)\n" \
+  "    -j - configurations to run at once (default one per core)\n" \
+  "\n"                                                      \
+
+#define SIM_MAX_SIZES 16
+
+static const char *policy_names[] = { "lru", "tinylfu" };
+static const char *layout_names[] = { "linear", "striped" };
+static const char *order_names[] = { "fifo", "elevator" };
+
+/* the model of one volume: the JBOD's position, its contents and the client's cache */
+typedef struct {
+  const sim_config_t *config;
+  cache_t *cache;
+  /* the cache shares payloads by content, so what the blocks hold decides how many fit */
+  uint8_t *volume;
+  int cur_disk;
+  int cur_block;
+  sim_result_t *result;
+} sim_state_t;
+
+static void charge(sim_state_t *s, int cost) {
+  s->result->cost += cost;
+  s->result->jbod_ops++;
+}
+
+static void locate(const sim_state_t *s, uint32_t global_block, int *disk, int *block) {
+  if (s->config->layout == SIM_LAYOUT_STRIPED) {
+    *disk = global_block % JBOD_NUM_DISKS;
+    *block = global_block / JBOD_NUM_DISKS;
+  } else {
+    *disk = global_block / JBOD_NUM_BLOCKS_PER_DISK;
+    *block = global_block % JBOD_NUM_BLOCKS_PER_DISK;
+  }
+}
+
+/* moves the JBOD to disk/block the way mdadm's seekTo does, then reads or
+ * writes it, which leaves the JBOD on the next block */
+static void access_block(sim_state_t *s, int disk, int block, int cost) {
+  if (s->cur_disk != disk) {
+    charge(s, SIM_COST_SEEK_TO_DISK);
+    s->cur_disk = disk;
+    s->cur_block = 0;
+  }
+  if (s->cur_block != block) {
+    charge(s, SIM_COST_SEEK_TO_BLOCK);
+    s->cur_block = block;
+  }
+  charge(s, cost);
+  if (++s->cur_block >= JBOD_NUM_BLOCKS_PER_DISK)
+    s->cur_disk = -1;
+}
+
+static const uint8_t *block_data(const sim_state_t *s, uint32_t global_block) {
+  return s->volume + (size_t)global_block * JBOD_BLOCK_SIZE;
+}
+
+static void read_block(sim_state_t *s, uint32_t global_block) {
+  int disk, block;
+  locate(s, global_block, &disk, &block);
+  if (s->cache) {
+    uint8_t hit[JBOD_BLOCK_SIZE];
+    s->result->lookups++;
+    if (cache_ctx_lookup(s->cache, disk, block, hit) == 1) {
+      s->result->hits++;
+      return;
+    }
+  }
+  access_block(s, disk, block, SIM_COST_READ_BLOCK);
+  if (s->cache)
+    cache_ctx_insert(s->cache, disk, block, block_data(s, global_block));
+}
+
+/* called once the volume holds the block's new contents */
+static void write_block(sim_state_t *s, uint32_t global_block) {
+  int disk, block;
+  locate(s, global_block, &disk, &block);
+  access_block(s, disk, block, SIM_COST_WRITE_BLOCK);
+  if (s->cache)
+    cache_ctx_insert(s->cache, disk, block, block_data(s, global_block));
+}
+
+static void replay(sim_state_t *s, const sim_op_t *op) {
+  uint32_t first = op->addr / JBOD_BLOCK_SIZE;
+  uint32_t last = (op->addr + op->len - 1) / JBOD_BLOCK_SIZE;
+
+  switch (op->type) {
+    case SIM_OP_MOUNT:
+      charge(s, SIM_COST_MOUNT);
+      s->cur_disk = -1;
+      /* the server starts every mount with zeroed disks */
+      memset(s->volume, 0, JBOD_NUM_DISKS * JBOD_DISK_SIZE);
+      break;
+    case SIM_OP_UNMOUNT:
+      charge(s, SIM_COST_UNMOUNT);
+      break;
+    case SIM_OP_SIGNALL:
+      break;
+    case SIM_OP_READ:
+      if (op->len == 0)
+        break;
+      for (uint32_t b = first; b <= last; ++b)
+        read_block(s, b);
+      break;
+    case SIM_OP_WRITE:
+      if (op->len == 0)
+        break;
+      /* partial blocks at either end are read first, as mdadm_write does */
+      if (op->addr % JBOD_BLOCK_SIZE)
+        read_block(s, first);
+      if ((op->addr + op->len) % JBOD_BLOCK_SIZE && !(first == last && op->addr % JBOD_BLOCK_SIZE))
+        read_block(s, last);
+      memset(s->volume + op->addr, op->fill, op->len);
+      for (uint32_t b = first; b <= last; ++b)
+        write_block(s, b);
+      break;
+  }
+}
+
+static bool is_barrier(const sim_op_t *op) {
+  return op->type != SIM_OP_READ && op->type != SIM_OP_WRITE;
+}
+
+/* sort key for the elevator: where the request starts on the disks */
+typedef struct {
+  const sim_op_t *op;
+  uint32_t key;
+} sim_pending_t;
+
+static int by_key(const void *a, const void *b) {
+  const sim_pending_t *x = a, *y = b;
+  if (x->key != y->key)
+    return x->key < y->key ? -1 : 1;
+  /* keeps the workload order among requests to the same place */
+  return x->op < y->op ? -1 : x->op > y->op;
+}
+
+int sim_run(const sim_op_t *ops, int num_ops, const sim_config_t *config, sim_result_t *result) {
+  sim_state_t s = { .config = config, .cur_disk = -1, .cur_block = -1, .result = result };
+  memset(result, 0, sizeof(*result));
+
+  s.volume = calloc(JBOD_NUM_DISKS, JBOD_DISK_SIZE);
+  if (!s.volume)
+    return -1;
+  if (config->cache_size > 0) {
+    s.cache = cache_ctx_create(config->cache_size);
+    if (!s.cache) {
+      free(s.volume);
+      return -1;
+    }
+    if (config->policy == SIM_POLICY_TINYLFU && cache_ctx_set_admission(s.cache, true) != 1) {
+      cache_ctx_destroy(s.cache);
+      free(s.volume);
+      return -1;
+    }
+  }
+
+  sim_pending_t window[SIM_REORDER_WINDOW];
+  int i = 0;
+  while (i < num_ops) {
+    if (config->order == SIM_ORDER_FIFO || is_barrier(&ops[i])) {
+      replay(&s, &ops[i++]);
+      continue;
+    }
+    /* sorts the requests up to the next barrier, a window at a time */
+    int n = 0;
+    while (i < num_ops && n < SIM_REORDER_WINDOW && !is_barrier(&ops[i])) {
+      int disk, block;
+      locate(&s, ops[i].addr / JBOD_BLOCK_SIZE, &disk, &block);
+      window[n].op = &ops[i++];
+      window[n++].key = disk * JBOD_NUM_BLOCKS_PER_DISK + block;
+    }
+    qsort(window, n, sizeof(window[0]), by_key);
+    for (int j = 0; j < n; ++j)
+      replay(&s, window[j].op);
+  }
+
+  if (s.cache)
+    cache_ctx_destroy(s.cache);
+  free(s.volume);
+  return 1;
+}
+
+static sim_op_t *load_workload(const char *workload, int *num_ops) {
+  FILE *f = fopen(workload, "r");
+  if (!f)
+    err(1, "Cannot open workload file %s", workload);
+
+  int cap = 1024, n = 0, line_num = 0;
+  sim_op_t *ops = malloc(cap * sizeof(sim_op_t));
+  char line[256], cmd[32];
+  uint32_t addr, len, ch;
+  while (ops && fgets(line, sizeof(line), f)) {
+    ++line_num;
+    line[strcspn(line, "\n")] = '\0';
+    if (n == cap) {
+      cap *= 2;
+      sim_op_t *grown = realloc(ops, cap * sizeof(sim_op_t));
+      if (!grown) {
+        free(ops);
+        ops = NULL;
+        break;
+      }
+      ops = grown;
+    }
+
+    sim_op_t *op = &ops[n++];
+    op->addr = op->len = 0;
+    op->fill = 0;
+    if (strcmp(line, "MOUNT") == 0) {
+      op->type = SIM_OP_MOUNT;
+    } else if (strcmp(line, "UNMOUNT") == 0) {
+      op->type = SIM_OP_UNMOUNT;
+    } else if (strcmp(line, "SIGNALL") == 0) {
+      op->type = SIM_OP_SIGNALL;
+    } else if (sscanf(line, "%7s %7u %4u %3u", cmd, &addr, &len, &ch) == 4 &&
+               (strcmp(cmd, "READ") == 0 || strcmp(cmd, "WRITE") == 0) &&
+               len <= 1024 && addr + len <= JBOD_NUM_DISKS * JBOD_DISK_SIZE) {
+      op->type = strcmp(cmd, "READ") == 0 ? SIM_OP_READ : SIM_OP_WRITE;
+      op->addr = addr;
+      op->len = len;
+      op->fill = ch;
+    } else {
+      errx(1, "Bad command [%s] on line %d, aborting.", line, line_num);
+    }
+  }
+  fclose(f);
+  if (!ops)
+    errx(1, "Out of memory loading %s", workload);
+
+  *num_ops = n;
+  return ops;
+}
+
+/* the configurations and where their results go, handed out to the workers in order */
+typedef struct {
+  const sim_op_t *ops;
+  int num_ops;
+  const sim_config_t *configs;
+  sim_result_t *results;
+  int num_configs;
+  _Atomic int next;
+} sim_sweep_t;
+
+static void *worker(void *arg) {
+  sim_sweep_t *sweep = arg;
+  int i;
+  while ((i = atomic_fetch_add(&sweep->next, 1)) < sweep->num_configs)
+    if (sim_run(sweep->ops, sweep->num_ops, &sweep->configs[i], &sweep->results[i]) != 1)
+      errx(1, "Failed to create a cache of %d entries.", sweep->configs[i].cache_size);
+  return NULL;
+}
+
+static int parse_sizes(char *list, int *sizes) {
+  int n = 0;
+  for (char *tok = strtok(list, ","); tok; tok = strtok(NULL, ",")) {
+    if (n == SIM_MAX_SIZES)
+      errx(1, "At most %d cache sizes, aborting.", SIM_MAX_SIZES);
+    sizes[n++] = atoi(tok);
+  }
+  return n;
+}
+
+int main(int argc, char *argv[])
+{
+  int ch, jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  int sizes[SIM_MAX_SIZES] = { 0, 16, 64, 256, 1024, 4096 };
+  int num_sizes = 6;
+  char *workload = NULL;
+
+  while ((ch = getopt(argc, argv, SIM_ARGUMENTS)) != -1) {
+    switch (ch) {
+      case 'h':
+        fprintf(stderr, USAGE);
+        return 0;
+      case 'w':
+        workload = optarg;
+        break;
+      case 's':
+        num_sizes = parse_sizes(optarg, sizes);
+        break;
+      case 'j':
+        jobs = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "Unknown command line option (%c), aborting.\n", ch);
+        return -1;
+    }
+  }
+
+  if (!workload || jobs < 1) {
+    fprintf(stderr, USAGE);
+    return -1;
+  }
+
+  int num_ops;
+  sim_op_t *ops = load_workload(workload, &num_ops);
+
+  /* every combination; without a cache there is no policy to vary */
+  sim_config_t configs[SIM_MAX_SIZES * 2 * 2 * 2];
+  int n = 0;
+  for (int s = 0; s < num_sizes; ++s)
+    for (int p = SIM_POLICY_LRU; p <= SIM_POLICY_TINYLFU; ++p) {
+      if (sizes[s] == 0 && p != SIM_POLICY_LRU)
+        continue;
+      for (int l = SIM_LAYOUT_LINEAR; l <= SIM_LAYOUT_STRIPED; ++l)
+        for (int o = SIM_ORDER_FIFO; o <= SIM_ORDER_ELEVATOR; ++o)
+          configs[n++] = (sim_config_t){ sizes[s], p, l, o };
+    }
+
+  sim_result_t results[SIM_MAX_SIZES * 2 * 2 * 2];
+  sim_sweep_t sweep = { ops, num_ops, configs, results, n, 0 };
+  if (jobs > n)
+    jobs = n;
+
+  int64_t start = monotonic_ns();
+  pthread_t threads[jobs];
+  for (int i = 0; i < jobs; ++i)
+    if (pthread_create(&threads[i], NULL, worker, &sweep) != 0)
+      errx(1, "Failed to start a worker thread.");
+  for (int i = 0; i < jobs; ++i)
+    pthread_join(threads[i], NULL);
+  int64_t elapsed = monotonic_ns() - start;
+
+  int best = 0;
+  for (int i = 1; i < n; ++i)
+    if (results[i].cost < results[best].cost)
+      best = i;
+
+  printf("%6s  %-8s %-8s %-9s %14s %12s %9s\n", "cache", "policy", "layout", "order", "cost", "jbod ops", "hit rate");
+  for (int i = 0; i < n; ++i) {
+    const sim_config_t *c = &configs[i];
+    const sim_result_t *r = &results[i];
+    printf("%6d  %-8s %-8s %-9s %14llu %12llu %8.1f%%%s\n", c->cache_size,
+           c->cache_size ? policy_names[c->policy] : "-", layout_names[c->layout], order_names[c->order],
+           (unsigned long long)r->cost, (unsigned long long)r->jbod_ops,
+           r->lookups ? 100.0 * r->hits / r->lookups : 0.0, i == best ? "  <- best" : "");
+  }
+  fprintf(stderr, "%d configurations of %d ops in %.2fs on %d threads\n", n, num_ops, elapsed / 1e9, jobs);
+
+  free(ops);
+  return 0;
+}
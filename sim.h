@@ -0,0 +1,74 @@
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdint.h>
+
+#include "jbod.h"
+
+/* An offline simulator: replays a tester workload against a model of the
+ * JBOD's geometry and cost table instead of a server, once for every
+ * combination of cache size, replacement policy, address layout and request
+ * ordering, and prints the predicted cost and hit rate of each. */
+
+/* what jbod.o charges for each command */
+#define SIM_COST_MOUNT 1000
+#define SIM_COST_UNMOUNT 1000
+#define SIM_COST_SEEK_TO_DISK 500
+#define SIM_COST_SEEK_TO_BLOCK 50
+#define SIM_COST_READ_BLOCK 100
+#define SIM_COST_WRITE_BLOCK 200
+#define SIM_COST_SIGN_BLOCK 0
+
+/* how many requests the elevator ordering may sort at a time */
+#define SIM_REORDER_WINDOW 16
+
+typedef enum {
+  SIM_OP_MOUNT,
+  SIM_OP_UNMOUNT,
+  SIM_OP_SIGNALL,
+  SIM_OP_READ,
+  SIM_OP_WRITE,
+} sim_op_type_t;
+
+typedef struct {
+  sim_op_type_t type;
+  uint32_t addr;
+  uint32_t len;
+  uint8_t fill;  /* the byte a write repeats, as tester does */
+} sim_op_t;
+
+typedef enum {
+  SIM_POLICY_LRU,
+  SIM_POLICY_TINYLFU,
+} sim_policy_t;
+
+/* how a volume address maps onto the disks */
+typedef enum {
+  SIM_LAYOUT_LINEAR,   /* disk after disk, as mdadm does */
+  SIM_LAYOUT_STRIPED,  /* consecutive blocks on consecutive disks */
+} sim_layout_t;
+
+typedef enum {
+  SIM_ORDER_FIFO,      /* as in the workload */
+  SIM_ORDER_ELEVATOR,  /* sorted by address within each window of requests */
+} sim_order_t;
+
+typedef struct {
+  int cache_size;  /* 0 for no cache */
+  sim_policy_t policy;
+  sim_layout_t layout;
+  sim_order_t order;
+} sim_config_t;
+
+typedef struct {
+  uint64_t cost;
+  uint64_t jbod_ops;
+  uint64_t lookups;
+  uint64_t hits;
+} sim_result_t;
+
+/* Returns 1 on success and -1 on failure. Replays the |num_ops| operations
+ * of |ops| under |config|. */
+int sim_run(const sim_op_t *ops, int num_ops, const sim_config_t *config, sim_result_t *result);
+
+#endif
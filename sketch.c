@@ -0,0 +1,66 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "sketch.h"
+#include "util.h"
+
+/* counters per row for each cache entry, and the aging period in increments per entry */
+#define SKETCH_WIDTH_FACTOR 4
+#define SKETCH_SAMPLE_FACTOR 10
+
+/* index of |key|'s counter in |row|, by double hashing */
+static uint32_t slot(const sketch_t *s, uint64_t hash, int row) {
+  uint32_t h1 = (uint32_t)hash;
+  uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+  return row * s->width + ((h1 + row * h2) & (s->width - 1));
+}
+
+static int get(const sketch_t *s, uint32_t i) {
+  return (s->counters[i / 2] >> ((i & 1) * 4)) & 0xf;
+}
+
+int sketch_init(sketch_t *s, int num_entries) {
+  uint32_t width = 16;
+  while (width < (uint32_t)num_entries * SKETCH_WIDTH_FACTOR)
+    width <<= 1;
+
+  s->counters = calloc(SKETCH_DEPTH * width / 2, 1);
+  if (!s->counters)
+    return -1;
+  s->width = width;
+  s->additions = 0;
+  s->sample_size = num_entries * SKETCH_SAMPLE_FACTOR;
+  return 1;
+}
+
+void sketch_free(sketch_t *s) {
+  free(s->counters);
+  s->counters = NULL;
+}
+
+void sketch_increment(sketch_t *s, uint64_t key) {
+  uint64_t hash = mix64(key);
+  for (int row = 0; row < SKETCH_DEPTH; ++row) {
+    uint32_t i = slot(s, hash, row);
+    if (get(s, i) < 15)
+      s->counters[i / 2] += 1 << ((i & 1) * 4);
+  }
+
+  /* halves every counter in both nibbles of each byte at once */
+  if (++s->additions >= s->sample_size) {
+    for (uint32_t i = 0; i < SKETCH_DEPTH * s->width / 2; ++i)
+      s->counters[i] = (s->counters[i] >> 1) & 0x77;
+    s->additions /= 2;
+  }
+}
+
+int sketch_estimate(const sketch_t *s, uint64_t key) {
+  uint64_t hash = mix64(key);
+  int estimate = 15;
+  for (int row = 0; row < SKETCH_DEPTH; ++row) {
+    int count = get(s, slot(s, hash, row));
+    if (count < estimate)
+      estimate = count;
+  }
+  return estimate;
+}
@@ -0,0 +1,31 @@
+#ifndef SKETCH_H_
+#define SKETCH_H_
+
+#include <stdint.h>
+
+/* A count-min sketch of 4-bit counters, used to estimate how often a key has
+ * been seen recently. Estimates never undercount (until aging), and saturate
+ * at 15. Once |sample_size| increments have been recorded every counter is
+ * halved, so old popularity fades. */
+typedef struct {
+  uint8_t *counters;  /* two 4-bit counters per byte, SKETCH_DEPTH rows */
+  uint32_t width;     /* counters per row, a power of two */
+  uint32_t additions;
+  uint32_t sample_size;
+} sketch_t;
+
+#define SKETCH_DEPTH 4
+
+/* Returns 1 on success and -1 on failure. Sizes the sketch for a cache of
+ * |num_entries| entries. */
+int sketch_init(sketch_t *s, int num_entries);
+
+void sketch_free(sketch_t *s);
+
+/* Records one occurrence of |key|. */
+void sketch_increment(sketch_t *s, uint64_t key);
+
+/* Returns the estimated number of recent occurrences of |key|. */
+int sketch_estimate(const sketch_t *s, uint64_t key);
+
+#endif
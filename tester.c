@@ -17,21 +17,36 @@
 #include "util.h"
 #include "tester.h"
 #include "net.h"
+#include "backend.h"
+#include "trace.h"
 
-#define TESTER_ARGUMENTS "hw:s:"
+#define TESTER_ARGUMENTS "hw:s:t:c:ab:m:r:"
 #define USAGE                                               \
-  "USAGE: test [-h] [-w workload-file] [-s cache_size] \n"  \
+  "USAGE: test [-h] [-w workload-file] [-s cache_size] [-t tcp|shm] [-c blocks] [-a] [-b backend] [-m name] [-r trace-file]\n" \
   "\n"                                                      \
   "where:\n"                                                \
   "    -h - help mode (display this message)\n"             \
+  "    -t - transport to the JBOD server (default tcp)\n"   \
+  "    -c - combine small writes in a buffer of this many blocks\n" \
+  "    -a - filter cache admission by access frequency (TinyLFU)\n" \
+  "    -b - block backend: net, net:IP:PORT, local or image:PATH[:DISKSxBLOCKS]\n" \
+  "    -m - share the cache with other processes through this shared memory name\n" \
+  "    -r - trace every request and write the spans to this file as Chrome trace JSON\n" \
   "\n"                                                      \
 
-int run_workload(char *workload, int cache_size);
+#define WRITE_COMBINING_WINDOW_MS 50
+
+int run_workload(char *workload, int cache_size, const char *cache_name, int wc_blocks, bool admission,
+                 jbod_backend_t *backend);
+int equals(const char *s1, const char *s2);
+static void export_trace(const char *trace_path);
 
 int main(int argc, char *argv[])
 {
-  int ch, cache_size = 0;
-  char *workload = NULL;
+  int ch, cache_size = 0, wc_blocks = 0;
+  bool admission = false;
+  char *workload = NULL, *backend_spec = NULL, *cache_name = NULL, *trace_path = NULL;
+  jbod_transport_t transport = JBOD_TRANSPORT_TCP;
 
   while ((ch = getopt(argc, argv, TESTER_ARGUMENTS)) != -1) {
     switch (ch) {
@@ -44,6 +59,29 @@ int main(int argc, char *argv[])
       case 'w':
         workload = optarg;
         break;
+      case 'c':
+        wc_blocks = atoi(optarg);
+        break;
+      case 'a':
+        admission = true;
+        break;
+      case 'b':
+        backend_spec = optarg;
+        break;
+      case 'm':
+        cache_name = optarg;
+        break;
+      case 'r':
+        trace_path = optarg;
+        break;
+      case 't':
+        if (equals(optarg, "shm")) {
+          transport = JBOD_TRANSPORT_SHM;
+        } else if (!equals(optarg, "tcp")) {
+          fprintf(stderr, "Unknown transport (%s), aborting.\n", optarg);
+          return -1;
+        }
+        break;
       default:
         fprintf(stderr, "Unknown command line option (%c), aborting.\n", ch);
         return -1;
@@ -55,15 +93,41 @@ int main(int argc, char *argv[])
     return -1;
   }
 
-  if (!jbod_connect(JBOD_SERVER, JBOD_PORT))
+  if (trace_path)
+    trace_start(1);
+
+  /* without -b, the workload runs on the default connection */
+  if (backend_spec) {
+    jbod_backend_t *backend = jbod_backend_open(backend_spec);
+    if (!backend) {
+      fprintf(stderr, "Cannot open backend (%s), aborting.\n", backend_spec);
+      return -1;
+    }
+    run_workload(workload, cache_size, cache_name, wc_blocks, admission, backend);
+    export_trace(trace_path);
+    jbod_backend_close(backend);
+    return 0;
+  }
+
+  if (!jbod_connect_transport(JBOD_SERVER, JBOD_PORT, transport))
     return -1;
   
-  run_workload(workload, cache_size);
+  run_workload(workload, cache_size, cache_name, wc_blocks, admission, jbod_backend_default());
+  export_trace(trace_path);
   jbod_disconnect();
 
   return 0;
 }
 
+static void export_trace(const char *trace_path) {
+  if (!trace_path)
+    return;
+  if (trace_export(trace_path) == -1)
+    warn("Cannot write trace file %s", trace_path);
+  else if (trace_dropped())
+    fprintf(stderr, "Trace buffers filled up, %llu spans dropped.\n", (unsigned long long)trace_dropped());
+}
+
 int equals(const char *s1, const char *s2) {
   return strncmp(s1, s2, strlen(s2)) == 0;
 }
@@ -80,7 +144,8 @@ uint32_t op = 0;
   return op;
 }
 
-int run_workload(char *workload, int cache_size) {
+int run_workload(char *workload, int cache_size, const char *cache_name, int wc_blocks, bool admission,
+                 jbod_backend_t *backend) {
   char line[256], cmd[32];
   uint8_t buf[MAX_IO_SIZE];
   uint32_t addr, len, ch;
@@ -93,24 +158,31 @@ int run_workload(char *workload, int cache_size) {
     err(1, "Cannot open workload file %s", workload);
 
   if (cache_size) {
-    rc = cache_create(cache_size);
+    rc = cache_name ? cache_create_shared(cache_name, cache_size) : cache_create(cache_size);
     if (rc != 1)
       errx(1, "Failed to create cache.");
+    if (admission && cache_set_admission(true) != 1)
+      errx(1, "Failed to set up cache admission.");
   }
 
+  if (wc_blocks && mdadm_set_write_combining(wc_blocks, WRITE_COMBINING_WINDOW_MS) != 1)
+    errx(1, "Failed to set up write combining.");
+
   int line_num = 0;
   while (fgets(line, 256, f)) {
     ++line_num;
     line[strlen(line)-1] = '\0';
     if (equals(line, "MOUNT")) {
-      rc = mdadm_mount();
+      rc = mdadm_mount_backend(backend);
     } else if (equals(line, "UNMOUNT")) {
       rc = mdadm_unmount();
     } else if (equals(line, "SIGNALL")) {
+      /* signatures come straight from the JBOD, so buffered writes go first */
+      rc = mdadm_flush();
       for (int i = 0; i < JBOD_NUM_DISKS; ++i)
         for (int j = 0; j < JBOD_NUM_BLOCKS_PER_DISK; ++j) {
           uint8_t b[JBOD_BLOCK_SIZE];
-          jbod_client_operation(encode_op(JBOD_SIGN_BLOCK, i, j), b);
+          backend->ops->operation(backend, encode_op(JBOD_SIGN_BLOCK, i, j), b);
           fprintf(stdout, "%s", b);
         }
     } else {
@@ -136,6 +208,8 @@ int run_workload(char *workload, int cache_size) {
 
   jbod_print_cost();
   cache_print_hit_rate();
+  if (cache_size)
+    cache_print_miss_ratio_curve();
 
   return 0;
 }
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "util.h"
+
+typedef struct {
+  const char *name;
+  int64_t start_ns;
+  int64_t dur_ns;
+  int nargs;
+  const char *keys[TRACE_MAX_ARGS];
+  int64_t values[TRACE_MAX_ARGS];
+} trace_span_t;
+
+typedef struct trace_buffer {
+  pthread_mutex_t lock;  /* the owning thread appends, trace_export reads */
+  int tid;
+  uint32_t count;
+  uint64_t dropped;
+  struct trace_buffer *next;
+  trace_span_t spans[TRACE_BUFFER_SPANS];
+} trace_buffer_t;
+
+static atomic_uint sample_every;
+static atomic_uint requests;
+
+/* every thread's buffer; they outlive their threads so the spans can still be exported */
+static pthread_mutex_t buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+static trace_buffer_t *buffers;
+static int next_tid = 1;
+
+static __thread int depth;
+static __thread bool sampled;
+static __thread trace_span_t open_spans[TRACE_MAX_DEPTH];
+static __thread trace_buffer_t *buffer;
+
+static trace_buffer_t *thread_buffer(void)
+{
+  if (buffer)
+    return buffer;
+  trace_buffer_t *b = malloc(sizeof(trace_buffer_t));
+  if (!b)
+    return NULL;
+  pthread_mutex_init(&b->lock, NULL);
+  b->count = 0;
+  b->dropped = 0;
+  pthread_mutex_lock(&buffers_lock);
+  b->tid = next_tid++;
+  b->next = buffers;
+  buffers = b;
+  pthread_mutex_unlock(&buffers_lock);
+  return buffer = b;
+}
+
+void trace_start(uint32_t every)
+{
+  atomic_store(&sample_every, every);
+}
+
+void trace_stop(void)
+{
+  atomic_store(&sample_every, 0);
+}
+
+void trace_begin(const char *name)
+{
+  if (depth == 0) {
+    uint32_t every = atomic_load_explicit(&sample_every, memory_order_relaxed);
+    sampled = every && atomic_fetch_add_explicit(&requests, 1, memory_order_relaxed) % every == 0;
+  }
+  if (sampled && depth < TRACE_MAX_DEPTH) {
+    trace_span_t *s = &open_spans[depth];
+    s->name = name;
+    s->nargs = 0;
+    s->start_ns = monotonic_ns();
+  }
+  depth++;
+}
+
+void trace_arg(const char *key, int64_t value)
+{
+  if (!sampled || depth == 0 || depth > TRACE_MAX_DEPTH)
+    return;
+  trace_span_t *s = &open_spans[depth - 1];
+  if (s->nargs < TRACE_MAX_ARGS) {
+    s->keys[s->nargs] = key;
+    s->values[s->nargs++] = value;
+  }
+}
+
+void trace_end(void)
+{
+  if (depth == 0)
+    return;
+  depth--;
+  if (!sampled || depth >= TRACE_MAX_DEPTH)
+    return;
+  trace_span_t *s = &open_spans[depth];
+  s->dur_ns = monotonic_ns() - s->start_ns;
+  trace_buffer_t *b = thread_buffer();
+  if (!b)
+    return;
+  pthread_mutex_lock(&b->lock);
+  if (b->count < TRACE_BUFFER_SPANS)
+    b->spans[b->count++] = *s;
+  else
+    b->dropped++;
+  pthread_mutex_unlock(&b->lock);
+}
+
+int trace_export(const char *path)
+{
+  FILE *f = fopen(path, "w");
+  if (!f)
+    return -1;
+  int pid = getpid();
+  bool first = true;
+  fprintf(f, "{\"traceEvents\":[\n");
+  pthread_mutex_lock(&buffers_lock);
+  for (trace_buffer_t *b = buffers; b; b = b->next) {
+    pthread_mutex_lock(&b->lock);
+    /* complete ("X") events, in microseconds */
+    for (uint32_t i = 0; i < b->count; i++) {
+      const trace_span_t *s = &b->spans[i];
+      fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+              first ? "" : ",\n", s->name, pid, b->tid, s->start_ns / 1e3, s->dur_ns / 1e3);
+      for (int a = 0; a < s->nargs; a++)
+        fprintf(f, "%s\"%s\":%lld", a ? "," : "", s->keys[a], (long long)s->values[a]);
+      fprintf(f, "}}");
+      first = false;
+    }
+    pthread_mutex_unlock(&b->lock);
+  }
+  pthread_mutex_unlock(&buffers_lock);
+  fprintf(f, "\n],\"displayTimeUnit\":\"ns\"}\n");
+  return (fclose(f) == 0) ? 0 : -1;
+}
+
+void trace_reset(void)
+{
+  pthread_mutex_lock(&buffers_lock);
+  for (trace_buffer_t *b = buffers; b; b = b->next) {
+    pthread_mutex_lock(&b->lock);
+    b->count = 0;
+    b->dropped = 0;
+    pthread_mutex_unlock(&b->lock);
+  }
+  pthread_mutex_unlock(&buffers_lock);
+}
+
+uint64_t trace_dropped(void)
+{
+  uint64_t dropped = 0;
+  pthread_mutex_lock(&buffers_lock);
+  for (trace_buffer_t *b = buffers; b; b = b->next) {
+    pthread_mutex_lock(&b->lock);
+    dropped += b->dropped;
+    pthread_mutex_unlock(&b->lock);
+  }
+  pthread_mutex_unlock(&buffers_lock);
+  return dropped;
+}
@@ -0,0 +1,45 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+
+/* Opt-in request tracing. A span is opened with trace_begin and closed with
+ * trace_end on the same thread; spans opened inside another span nest in it.
+ * Whether a request is traced is decided when its outermost span opens: one
+ * in every |sample_every| of them is, and the spans inside follow that choice,
+ * so a sampled request is traced whole. Finished spans go into a buffer of
+ * the thread's own, and trace_export writes every thread's spans in the Chrome
+ * trace event format, which chrome://tracing and Perfetto show as a timeline.
+ *
+ * Span names and argument keys are kept by pointer and must be string
+ * literals. While tracing is off a span costs a thread-local counter. */
+
+/* spans nested deeper than this are not recorded */
+#define TRACE_MAX_DEPTH 32
+#define TRACE_MAX_ARGS 3
+/* spans kept per thread; later ones are dropped until trace_reset */
+#define TRACE_BUFFER_SPANS 16384
+
+/* Starts tracing one request in every |sample_every| (1 traces them all, 0
+ * stops tracing). Spans already recorded are kept. */
+void trace_start(uint32_t sample_every);
+void trace_stop(void);
+
+void trace_begin(const char *name);
+
+/* Attaches |key| = |value| to the innermost open span. */
+void trace_arg(const char *key, int64_t value);
+
+void trace_end(void);
+
+/* Returns 0 on success and -1 on failure. Writes the spans recorded so far,
+ * by every thread, to |path| as a Chrome trace event JSON file. */
+int trace_export(const char *path);
+
+/* Forgets the spans recorded so far. */
+void trace_reset(void);
+
+/* spans lost to full buffers since the last trace_reset */
+uint64_t trace_dropped(void);
+
+#endif
@@ -4,6 +4,7 @@
 #include <fcntl.h>
 #include <stdint.h>
 #include <assert.h>
+#include <time.h>
 #include <openssl/sha.h>
 #include <openssl/rand.h>
 
@@ -55,3 +56,18 @@ uint32_t get_rand(uint32_t min, uint32_t max) {
     v = max;
   return v;
 }
+
+int64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t mix64(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
@@ -9,5 +9,8 @@ void debug_log(const char *fmt, ...);
 
 const char *sha1_sig(uint8_t *buf, uint32_t size);
 uint32_t get_rand(uint32_t min, uint32_t max);
+int64_t monotonic_ns(void);
+/* a 64-bit finalizer that spreads the bits of |x| well, for hashing keys */
+uint64_t mix64(uint64_t x);
 
 #endif
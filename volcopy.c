@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#include "volcopy.h"
+#include "mdadm.h"
+#include "backend.h"
+#include "util.h"
+
+#define VOLCOPY_ARGUMENTS "hb:a:l:cd"
+#define USAGE                                               \
+  "USAGE: volcopy [-h] [-b backend] [-a addr] [-l len] [-c] [-d] export|import file\n" \
+  "\n"                                                      \
+  "where:\n"                                                \
+  "    -h - help mode (display this message)\n"             \
+  "    -b - block backend: net, net:IP:PORT, local or image:PATH[:DISKSxBLOCKS] (default net)\n" \
+  "    -a - first byte of the volume to copy, a multiple of the block size (default 0)\n" \
+  "    -l - bytes to copy, a multiple of the block size (default to the end of the volume, if under 4 GiB)\n" \
+  "    -c - print a checksum of the bytes copied\n"         \
+  "    -d - read or write the file with O_DIRECT\n"         \
+  "\n"                                                      \
+  "export copies the volume to the file, import copies the file to the volume.\n"
+
+int main(int argc, char *argv[])
+{
+  int ch, flags = 0;
+  const char *backend_spec = VOLCOPY_DEFAULT_BACKEND;
+  uint32_t addr = 0, len = 0;
+
+  while ((ch = getopt(argc, argv, VOLCOPY_ARGUMENTS)) != -1) {
+    switch (ch) {
+      case 'h':
+        fprintf(stderr, USAGE);
+        return 0;
+      case 'b':
+        backend_spec = optarg;
+        break;
+      case 'a':
+        addr = strtoul(optarg, NULL, 0);
+        break;
+      case 'l':
+        len = strtoul(optarg, NULL, 0);
+        break;
+      case 'c':
+        flags |= MDADM_COPY_CHECKSUM;
+        break;
+      case 'd':
+        flags |= MDADM_COPY_DIRECT;
+        break;
+      default:
+        fprintf(stderr, "Unknown command line option (%c), aborting.\n", ch);
+        return -1;
+    }
+  }
+
+  if (argc - optind != 2 || (strcmp(argv[optind], "export") != 0 && strcmp(argv[optind], "import") != 0)) {
+    fprintf(stderr, USAGE);
+    return -1;
+  }
+  int export = strcmp(argv[optind], "export") == 0;
+  const char *path = argv[optind + 1];
+
+  jbod_backend_t *backend = jbod_backend_open(backend_spec);
+  if (!backend)
+    errx(1, "Cannot open backend (%s), aborting.", backend_spec);
+  if (mdadm_mount_backend(backend) != 1)
+    errx(1, "Cannot mount the volume, aborting.");
+
+  /* a copy is at most 4 GiB - 1, which the largest geometry is one byte past */
+  uint64_t size = mdadm_volume_size();
+  if (addr >= size || (len == 0 && size - addr > UINT32_MAX)) {
+    mdadm_unmount();
+    jbod_backend_close(backend);
+    if (addr >= size)
+      errx(1, "Address %u is past the end of the volume (%llu bytes), aborting.", addr, (unsigned long long)size);
+    errx(1, "The %llu bytes from %u to the end of the volume are too many for one copy, give -l; aborting.",
+         (unsigned long long)(size - addr), addr);
+  }
+  if (len == 0)
+    len = size - addr;
+
+  uint64_t checksum = 0;
+  int64_t start = monotonic_ns();
+  int rc = export ? mdadm_copy_out(addr, len, path, flags, &checksum) : mdadm_copy_in(path, addr, len, flags, &checksum);
+  double elapsed = (monotonic_ns() - start) / 1e9;
+  if (rc == 1 && mdadm_flush() != 1)
+    rc = -1;
+  mdadm_unmount();
+  jbod_backend_close(backend);
+  if (rc != 1)
+    errx(1, "Failed to %s %u bytes at %u %s %s.", argv[optind], len, addr, export ? "to" : "from", path);
+
+  printf("%s %u bytes in %.3f s, %.1f MB/s\n", export ? "Exported" : "Imported", len, elapsed,
+         elapsed > 0 ? len / elapsed / 1e6 : 0);
+  if (flags & MDADM_COPY_CHECKSUM)
+    printf("Checksum: %016llx\n", (unsigned long long)checksum);
+  return 0;
+}
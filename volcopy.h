@@ -0,0 +1,12 @@
+#ifndef VOLCOPY_H_
+#define VOLCOPY_H_
+
+/* A command line tool that copies a volume, or a range of it, to a local
+ * file or back with mdadm_copy_out and mdadm_copy_in, and reports the
+ * throughput. It mounts the volume itself, so against a JBOD server it sees
+ * what that server keeps across mounts; an image backend keeps everything. */
+
+/* where the volume is, as for tester -b */
+#define VOLCOPY_DEFAULT_BACKEND "net"
+
+#endif